@@ -163,13 +163,24 @@ namespace sc {
     // TODO: This wastes a TON of memory but we don't really care, right?
     extern uint64_t zob_Pieces[BOARD_SIZE][NUM_COLORED_PIECE_TYPES];
 
+    // tapered piece-square tables, material included, in centipawns from white's point of view.
+    // Position::set() and clear() keep their sums in StateInfo along with the hash. see psqt.cpp
+    extern int16_t psqt_Mg[BOARD_SIZE][NUM_COLORED_PIECE_TYPES];
+    extern int16_t psqt_Eg[BOARD_SIZE][NUM_COLORED_PIECE_TYPES];
+    extern int8_t psqt_Phase[NUM_COLORED_PIECE_TYPES]; // how much a piece counts towards the middlegame
+
+    constexpr int MAX_PHASE = 24; // the phase of the starting position. promotions can push it higher
+
+    // fills the tables above. called by init_movegen()
+    void init_psqt();
+
     // see https://github.com/official-stockfish/Stockfish/blob/0a318cdddf8b6bdd05c2e0ee9b3b61a031d398ed/src/types.h#L112
+    // packed into 16 bits. move ordering scores live next to the moves in MoveList instead
     struct Move {
-        Square src; // : 6
-        Square dst; // : 6
-        PromoteType promote; // : 2
-        MoveType typeFlags; // : 2
-        int_fast16_t ranking; // used for move ordering
+        uint16_t src : 6;
+        uint16_t dst : 6;
+        uint16_t promote : 2;   // a PromoteType
+        uint16_t typeFlags : 2; // a MoveType
 
         inline constexpr bool operator==(const Move rhs) const {
             return src == rhs.src && dst == rhs.dst && promote == rhs.promote && typeFlags == rhs.typeFlags;
@@ -185,9 +196,28 @@ namespace sc {
         // note: this doesn't append stuff for check and mate. manually do that by querying it after
         // calling make_move()
         [[nodiscard]] std::string standard_alg_notation(const Position &pos) const;
+    };
+    static_assert(sizeof(Move) == 2);
+
+    // the pieces the last move took off the board and put on it, for evaluators that update incrementally.
+    // a castle removes and adds two, anything else adds one and removes one or two. the moving piece (the king,
+    // when castling) always comes first
+    struct DirtyPieces {
+        uint8_t numAdded = 0;
+        uint8_t numRemoved = 0;
+        ColoredType added[2];
+        Square addedSq[2];
+        ColoredType removed[2];
+        Square removedSq[2];
+
+        inline void add(const ColoredType piece, const Square sq) {
+            added[numAdded] = piece;
+            addedSq[numAdded++] = sq;
+        }
 
-        bool operator<(const Move &rhs) const {
-            return ranking < rhs.ranking;
+        inline void remove(const ColoredType piece, const Square sq) {
+            removed[numRemoved] = piece;
+            removedSq[numRemoved++] = sq;
         }
     };
 
@@ -195,6 +225,7 @@ namespace sc {
     struct StateInfo {
         StateInfo *prev = nullptr; // history of game states is kept in a linked list.
         uint64_t hash = 0x927b1a7aed74a025ULL;
+        uint64_t pawnHash = 0; // zob_Pieces of the pawns only, for the pawn hash table
         int halfmoves = 0; // number of plies since a capture or pawn advance
 
         CastlingRights castlingRights;
@@ -203,11 +234,45 @@ namespace sc {
 
         Move prevMove{};
 
-        uint8_t reps = 0;
+        // sums of the piece-square tables over the board, white's point of view, and the game phase.
+        // kept up to date by Position::set() and clear(), so unmaking a move restores them for free
+        int psqtMg = 0;
+        int psqtEg = 0;
+        int phase = 0;
+
+        DirtyPieces dirty{}; // what prevMove changed. make_move() fills it in, nothing else does
+
+        // derived from the board by update_check_info(), whenever the board changes. being in the state, they
+        // come back for free with unmake_move()
+        Bitboard checkers = 0; // the opponent's pieces giving check to the side to move
+        Bitboard blockers[NUM_SIDES]{}; // pieces of either side that are all that stands between a king and a slider
+        Bitboard pinners[NUM_SIDES]{}; // the sliders pinning one of a side's own pieces to its king
+
+        // the squares the opponent attacks, seeing through our king. only needed to move the king, so the move
+        // generator works it out the first time it needs it
+        Bitboard attacked = 0;
+        bool attackedValid = false;
     };
 
     class MoveList;
 
+    // what generate_moves() produces
+    enum GenOutput : uint_fast8_t {
+        GEN_LIST,  // push every move into the list
+        GEN_COUNT, // only count the moves. mostly popcounts, no move is ever created
+        GEN_ANY    // stop at the first legal move found. returns 1 if there is one, 0 otherwise
+    };
+
+    // which moves generate_moves() produces. GEN_CAPTURES and GEN_QUIETS split GEN_ALL in two
+    enum GenType : uint_fast8_t {
+        GEN_ALL,
+        GEN_CAPTURES, // captures, en passant and promotions. every evasion when in check
+        GEN_QUIETS    // all other moves, castling included. nothing at all when in check
+    };
+
+    // recomputes the checkers, blockers and pinners of pos's state, and marks its attacked squares out of date
+    void update_check_info(Position &pos);
+
     // TODO: Deepcopy the linked list that is in state
     class Position {
     public:
@@ -228,10 +293,20 @@ namespace sc {
             byType[type] |= to_bitboard(p);
             byColor[side] |= to_bitboard(p);
             state.hash ^= zob_Pieces[p][pieces[p]];
+            if (type == PAWN)
+                state.pawnHash ^= zob_Pieces[p][pieces[p]];
+            state.psqtMg += psqt_Mg[p][pieces[p]];
+            state.psqtEg += psqt_Eg[p][pieces[p]];
+            state.phase += psqt_Phase[pieces[p]];
         }
 
         inline void clear(const Square p) {
             state.hash ^= zob_Pieces[p][pieces[p]];
+            if (type_of(pieces[p]) == PAWN)
+                state.pawnHash ^= zob_Pieces[p][pieces[p]];
+            state.psqtMg -= psqt_Mg[p][pieces[p]];
+            state.psqtEg -= psqt_Eg[p][pieces[p]];
+            state.phase -= psqt_Phase[pieces[p]];
             byType[type_of(pieces[p])] &= ~to_bitboard(p); 
             byColor[side_of(pieces[p])] &= ~to_bitboard(p);
             pieces[p] = NULL_COLORED_TYPE;
@@ -242,7 +317,7 @@ namespace sc {
 
         [[nodiscard]] constexpr inline const StateInfo &get_state() const { return state; }
         [[nodiscard]] constexpr inline ColoredType piece_at(const Square ind) const { return pieces[ind]; }
-        [[nodiscard]] constexpr inline bool in_check() const { return isInCheck; }
+        [[nodiscard]] constexpr inline bool in_check() const { return state.checkers != 0; }
         [[nodiscard]] constexpr Side get_turn() const { return turn; }
 
         // copy this position into another memory location. Deep copies.
@@ -259,22 +334,22 @@ namespace sc {
         int fullmoves = 1; // increment every time black moves
         Side turn = WHITE_SIDE;
 
-        // TODO: Currently this flag is reset back to false by any unmake_move() so.... it really should be a part of the state info
-        bool isInCheck = false; // this flag is set by standard_moves() if it detects that the side it generated moves for is in check.
-
-        friend void make_move(Position &pos, const Move mov, StateInfo *);
+        friend void make_move(Position &pos, const Move mov, StateInfo *, bool);
         friend void unmake_move(Position &pos, const Move mov);
+        friend void make_null_move(Position &pos, StateInfo *, bool);
+        friend void unmake_null_move(Position &pos);
         friend struct ::sc::makeimpl::PositionFriend;
+        friend void update_check_info(Position &pos);
 
-        template <Side, bool>
-        friend void standard_moves(MoveList &ls, Position &pos);
+        template <Side, GenType, GenOutput>
+        friend int generate_moves(MoveList *ls, Position &pos);
     };
 
     template <MoveType TYPE>
-    constexpr inline Move new_move(const Square from, const Square to) { return Move{from, to, PROMOTE_QUEEN, TYPE, 0}; }
+    constexpr inline Move new_move(const Square from, const Square to) { return Move{from, to, PROMOTE_QUEEN, TYPE}; }
     constexpr inline Move new_move_normal(const Square from, const Square to) { return new_move<NORMAL>(from, to); }
     constexpr inline Move new_promotion(const Square from, const Square to, const PromoteType promote) {
-        return Move{from, to, promote, PROMOTION, 4096 * 2}; // really high ranking: search promotions first!
+        return Move{from, to, promote, PROMOTION};
     }
 
 
@@ -1,5 +1,11 @@
 #pragma once
 
 namespace sc {
+    // have the search ask make_move() and make_null_move() to prefetch the child position's transposition
+    // table bucket
+    constexpr bool PREFETCH_TT = true;
 
+    // count the cycles the search spends inside transposition table probes, for bench's ttcycles/node.
+    // the fenced rdtsc around every probe costs 10-20% of the search speed, so only turn it on to measure
+    constexpr bool TIME_TT_PROBES = false;
 }
@@ -1,11 +1,14 @@
 #pragma once
 
 #include "scacus/movegen.hpp"
+#include "scacus/tt.hpp"
 
 #include <thread>
 #include <atomic>
 #include <mutex>
-#include <queue>
+#include <chrono>
+#include <functional>
+#include <memory>
 
 #include <cstring> // memset
 #include <unordered_map>
@@ -16,32 +19,55 @@ namespace sc {
     using ScoreT = int;
 
     constexpr auto QUIESC_DEPTH = 0;
+    constexpr DepthT MAX_DEPTH = 99;
+    constexpr int MAX_PLY = 128; // the search never goes further from the root than this
     constexpr ScoreT PAWN_SCORE = 512;
 
     // We can't actually use min because -min is not max! In fact, -min is negative! 
     constexpr auto MATE_SCORE = -10000 * PAWN_SCORE;
-    constexpr auto MATE_STEP = 200 * PAWN_SCORE;
+    constexpr auto MATE_STEP = 1; // being mated a ply later scores this much better
     constexpr auto MIN_SCORE = std::numeric_limits<ScoreT>::min() + 2;
     constexpr auto MAX_SCORE = std::numeric_limits<ScoreT>::max() - 2;
 
-    constexpr auto MOBILITY_VALUE = PAWN_SCORE / 512;
+    // scores at least this far from 0 are mates (or infinite bounds). no search gets 10000 plies deep
+    constexpr ScoreT MATE_BOUND = -(MATE_SCORE + 10000 * MATE_STEP);
 
+    inline constexpr bool is_mate_score(const ScoreT score) {
+        return score >= MATE_BOUND || score <= -MATE_BOUND;
+    }
 
-    // transposition tables are global and defined in engine.cpp
 
-    struct SearchTask {
-        Move mov{};
-        DepthT depth = QUIESC_DEPTH;
-        ScoreT score = 0;
+    // the transposition table is global and defined in tt.cpp
 
-        bool operator<(const SearchTask &rhs) const {
-            if (depth == rhs.depth)
-                return score < rhs.score;
-            return depth > rhs.depth;
-            // return (10.0 + score) / (1.0 + 10.0 * depth) < (10.0 + score) / (1.0 + 10.0 * rhs.depth);
+    // what the GUI told us in its go command. times are in milliseconds; 0 means not given.
+    struct SearchLimits {
+        int64_t time[NUM_SIDES] = {0, 0}; // remaining clock time, indexed by Side
+        int64_t inc[NUM_SIDES] = {0, 0};
+        int movestogo = 0;
+        int64_t movetime = 0;
+        DepthT depth = MAX_DEPTH;
+        uint64_t nodes = 0;
+        bool infinite = false;
+        bool ponder = false; // searching on the opponent's time. the clock only starts at ponderhit
+
+        [[nodiscard]] inline bool uses_clock(const Side side) const {
+            return !infinite && (movetime || time[side]);
         }
     };
 
+    // the selective parts of the search. all on by default; switching them off is for A/B testing
+    // with the bench command, see the UCI options of the same names
+    struct SearchOptions {
+        bool nullMove = true;     // NullMovePruning
+        bool lmr = true;          // LateMoveReductions
+        bool futility = true;     // FutilityPruning: reverse futility pruning too
+        bool deltaPruning = true; // DeltaPruning, in the quiescence search
+        bool nnue = false;        // UseNNUE: evaluate with the network loaded from EvalFile, if there is one
+    };
+
+    class SearchThread; // defined in engine.cpp
+    struct ThreadData;  // likewise
+
     class EngineV2 {
     private:
         Position *pos;
@@ -49,31 +75,97 @@ namespace sc {
         // why did i name some with camelCase and some with snake_case?
         // i don't even know
         std::vector<std::thread> workers;
-        std::priority_queue<SearchTask> tasks;
-        std::mutex taskMtx, bestMtx;
-        std::condition_variable taskCv;
+        std::mutex bestMtx;
+
+        // what each search thread keeps on the heap, by thread index. kept from one search to the next, so
+        // the caches in there stay warm
+        std::vector<std::unique_ptr<ThreadData>> threadData;
 
         struct EngineLine {
             Move best_mov{};
             ScoreT best_score = MIN_SCORE;
+            std::vector<Move> pv; // starts with best_mov, unless the search didn't get to finish depth 1
         };
 
-        EngineLine prelim_line, true_line;
-        DepthT search_depth = 0; // the depth level we are currently searching
+        EngineLine true_line; // result of the last iteration the main thread finished
+        DepthT search_depth = 0; // the last depth the main thread finished
+
+        using Clock = std::chrono::steady_clock;
+        SearchLimits limits;
+        std::atomic<Clock::time_point> startTime; // reset by ponderhit(), hence atomic
+        int64_t softLimit = 0; // don't start another iteration after this many ms. 0 = no limit
+        int64_t hardLimit = 0; // abort the search after this many ms. 0 = no limit
+        int64_t moveOverhead = 10; // ms lost to communication per move, see the Move Overhead option
+        SearchOptions options;
+
+        // called by the main search thread once the search is over, see set_bestmove_callback()
+        std::function<void(Move, Move)> onBestMove;
+
+        // true while a go ponder search hasn't gotten its ponderhit (or stop) yet
+        std::atomic<bool> pondering = false;
+        std::mutex ponderMtx;
+        std::condition_variable ponderCv;
+
+        // the move we expect the opponent to answer the best move with, read from the TT. null if none
+        [[nodiscard]] Move ponder_move() const;
+
+        void init_time_limits();
 
-        std::atomic<bool> running = true;
+        // checked by the main thread every few nodes
+        void check_hard_limits();
 
-        friend void workerFunc(EngineV2 *);
+        // checked by the main thread between iterations
+        [[nodiscard]] bool should_stop_iterating(int stableIterations, size_t numRootMoves) const;
+
+        std::atomic<bool> running = false; // true from start_search() until the search stops or is stopped
+        std::atomic<uint64_t> nodes = 0; // nodes searched by all threads since start_search()
+        std::atomic<uint64_t> ttProbeCycles = 0; // cycles those nodes spent probing the TT, see TIME_TT_PROBES
+        std::atomic<uint64_t> cutoffs = 0; // beta cutoffs in the main search, once all threads are done
+        std::atomic<uint64_t> firstMoveCutoffs = 0; // those of them caused by the first move searched
+        std::atomic<uint64_t> pawnProbes = 0; // pawn hash table lookups, once all threads are done
+        std::atomic<uint64_t> pawnHits = 0;
+        std::atomic<uint64_t> evalProbes = 0; // eval cache lookups, likewise
+        std::atomic<uint64_t> evalHits = 0;
+        unsigned numThreads = std::max(1U, std::thread::hardware_concurrency());
+
+        friend void workerFunc(EngineV2 *, unsigned);
+        friend class SearchThread;
 
     public:
-        EngineV2() = default;
+        EngineV2();
+        ~EngineV2();
 
         EngineV2(const EngineV2 &) = delete;
         EngineV2 &operator=(const EngineV2 &) = delete;
 
-        void start_search(int maxDepth = 99);
+        void start_search(const SearchLimits &lim);
+        inline void start_search(DepthT depthLimit = MAX_DEPTH) {
+            SearchLimits lim;
+            lim.depth = depthLimit;
+            start_search(lim);
+        }
+
+        // stops the search and waits for all of its threads to exit. the bestmove callback has run by the
+        // time this returns. does nothing if no search is running
         void stop_search();
 
+        // blocks until the search stops on its own, i.e. by hitting one of its limits
+        void wait_search();
+
+        // the opponent played the move we were pondering on: keep searching, but as a normal timed search.
+        // everything searched so far stays in the TT and in the iteration we're in.
+        void ponderhit();
+
+        // `f` gets the best move and the expected reply (null if unknown) when a search finishes, whether
+        // it hit a limit or got stopped. it runs on a search thread. not safe to change while searching
+        inline void set_bestmove_callback(std::function<void(Move, Move)> f) {
+            onBestMove = std::move(f);
+        }
+
+        [[nodiscard]] inline int64_t elapsed_ms() const {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - startTime.load()).count();
+        }
+
         inline void set_pos(Position *p) {
             pos = p;
         }
@@ -90,5 +182,54 @@ namespace sc {
         inline bool is_running() const {
             return running;
         }
+
+        inline void set_move_overhead(int64_t ms) {
+            moveOverhead = std::max<int64_t>(0, ms);
+        }
+
+        // not safe to change while searching
+        [[nodiscard]] inline SearchOptions &search_options() {
+            return options;
+        }
+
+        // forgets the cached evaluations of every thread. for when the evaluation changes, e.g. a new network.
+        // not safe to call while searching
+        void clear_eval_caches();
+
+        // takes effect on the next start_search()
+        inline void set_threads(unsigned n) {
+            numThreads = std::max(1U, n);
+        }
+
+        [[nodiscard]] inline unsigned get_threads() const {
+            return numThreads;
+        }
+
+        [[nodiscard]] inline uint64_t node_count() const {
+            return nodes.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] inline uint64_t tt_probe_cycles() const {
+            return ttProbeCycles.load(std::memory_order_relaxed);
+        }
+
+        // the share of beta cutoffs that came from the first move searched, over all threads of the last
+        // finished search. the closer to 1, the better the move ordering
+        [[nodiscard]] inline double first_move_cutoff_rate() const {
+            const uint64_t total = cutoffs.load(std::memory_order_relaxed);
+            return total ? static_cast<double>(firstMoveCutoffs.load(std::memory_order_relaxed)) / total : 0.0;
+        }
+
+        // the share of the last finished search's pawn hash table lookups that found their entry
+        [[nodiscard]] inline double pawn_hash_hit_rate() const {
+            const uint64_t total = pawnProbes.load(std::memory_order_relaxed);
+            return total ? static_cast<double>(pawnHits.load(std::memory_order_relaxed)) / total : 0.0;
+        }
+
+        // the share of the last finished search's static evaluations that came out of the eval cache
+        [[nodiscard]] inline double eval_cache_hit_rate() const {
+            const uint64_t total = evalProbes.load(std::memory_order_relaxed);
+            return total ? static_cast<double>(evalHits.load(std::memory_order_relaxed)) / total : 0.0;
+        }
     };
 }
\ No newline at end of file
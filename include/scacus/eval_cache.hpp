@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace sc {
+    // Remembers static evaluations by StateInfo::hash, so that positions reached again through transpositions
+    // (the quiescence search is full of those) don't get evaluated twice. Direct mapped, one per thread and
+    // small enough to stay in L2. An entry is the upper half of the hash and the score: the lower half
+    // picks the slot.
+    class EvalCache {
+    private:
+        static constexpr size_t ENTRIES = 1 << 15; // 256KB
+
+        struct Entry {
+            uint32_t key;
+            int32_t score;
+        };
+
+        Entry entries[ENTRIES]{};
+        uint64_t probes = 0;
+        uint64_t hits = 0;
+
+    public:
+        inline bool probe(const uint64_t hash, int &score) {
+            const Entry &e = entries[hash & (ENTRIES - 1)];
+            probes++;
+            if (e.key != static_cast<uint32_t>(hash >> 32))
+                return false;
+
+            hits++;
+            score = e.score;
+            return true;
+        }
+
+        inline void store(const uint64_t hash, const int score) {
+            entries[hash & (ENTRIES - 1)] = Entry{static_cast<uint32_t>(hash >> 32), score};
+        }
+
+        inline void reset_stats() {
+            probes = hits = 0;
+        }
+
+        [[nodiscard]] inline uint64_t get_probes() const {
+            return probes;
+        }
+
+        [[nodiscard]] inline uint64_t get_hits() const {
+            return hits;
+        }
+    };
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "scacus/movegen.hpp"
+
+#include <algorithm>
+
+namespace sc {
+    // The hashes of the positions leading up to the current one, oldest first, in one flat array. A search
+    // thread seeds it from the game once, then pushes and pops a key with every move it makes, so looking
+    // for a repetition is a short backward scan over contiguous memory instead of a walk over the StateInfo
+    // list, through the stack frames of the search and the UCI's states.
+    template <int CAPACITY>
+    class KeyHistory {
+    private:
+        uint64_t keys[CAPACITY];
+        int count = 0;
+
+    public:
+        // starts over from pos and the positions before it, as far back as its halfmove clock goes (nothing
+        // before the last capture or pawn move can come up again), and at most maxBack of them
+        void seed(const Position &pos, int maxBack) {
+            const int limit = std::min({pos.get_state().halfmoves, maxBack, CAPACITY - 1});
+
+            int back = 0;
+            for (const StateInfo *st = pos.get_state().prev; st && back < limit; st = st->prev)
+                back++;
+
+            count = back + 1;
+            keys[back] = pos.get_state().hash;
+            const StateInfo *st = pos.get_state().prev;
+            for (int i = back - 1; i >= 0; i--, st = st->prev)
+                keys[i] = st->hash;
+        }
+
+        inline void push(const uint64_t key) {
+            keys[count++] = key;
+        }
+
+        inline void pop() {
+            count--;
+        }
+
+        // whether the newest position already came up in the last `window` plies, which is meant to be its
+        // halfmove clock. only every other one can match, since the side to move is part of the hash, and
+        // it takes at least four plies to get back to the same position
+        [[nodiscard]] inline bool is_repetition(const int window) const {
+            const uint64_t key = keys[count - 1];
+            const int stop = std::max(count - 1 - window, 0);
+            for (int i = count - 5; i >= stop; i -= 2)
+                if (keys[i] == key)
+                    return true;
+            return false;
+        }
+
+        // whether the side to move has a move that gets back to one of the positions of the last `window`
+        // plies, so that the position is at least a draw: an upcoming repetition. ply: how many of the
+        // positions belong to the search, the rest came before the root.
+        // see http://web.archive.org/web/20201107002606/https://marcelk.net/2013-04-06/paper/upcoming-rep-v2.pdf
+        [[nodiscard]] bool has_game_cycle(const Position &pos, const int window, const int ply) const {
+            const uint64_t key = keys[count - 1];
+            const Bitboard occ = pos.by_side(WHITE_SIDE) | pos.by_side(BLACK_SIDE);
+
+            // a position an odd number of plies back has the other side to move, which the cuckoo keys include
+            for (int i = 3; i <= window && i < count; i += 2) {
+                const uint64_t diff = key ^ keys[count - 1 - i];
+                int slot = cuckoo_h1(diff);
+                if (CUCKOO_KEYS[slot] != diff) {
+                    slot = cuckoo_h2(diff);
+                    if (CUCKOO_KEYS[slot] != diff)
+                        continue;
+                }
+
+                // the piece has to be able to get there
+                const Move mov = CUCKOO_MOVES[slot];
+                if ((pin_line(mov.src, mov.dst) ^ to_bitboard(mov.dst)) & occ)
+                    continue;
+
+                // inside the tree either side closing the cycle will do. before the root, the move has to be ours
+                if (ply > i)
+                    return true;
+                const Square from = pos.piece_at(mov.src) != NULL_COLORED_TYPE ? mov.src : mov.dst;
+                if (side_of(pos.piece_at(from)) == pos.get_turn())
+                    return true;
+            }
+            return false;
+        }
+    };
+}
@@ -3,13 +3,16 @@
 #include "scacus/bitboard.hpp"
 
 namespace sc {
-    class MoveList {
+    // cache line aligned, so that the per-ply lists of a search thread (see SearchThread::moveStack) don't
+    // share lines with each other
+    class alignas(64) MoveList {
     public:
         Move data[256];
+        int16_t scores[256]; // for move ordering, scores[i] goes with head[i]. whoever orders the moves sets them
         Move *head = nullptr;
         Move *tail = nullptr;
 
-        inline MoveList() = delete;
+        inline MoveList() : head(data), tail(head) {};
 
         MoveList &operator=(const MoveList &&rhs) noexcept = delete;
         MoveList(const MoveList &rhs) noexcept = delete;
@@ -58,6 +61,11 @@ namespace sc {
             return head[x];
         }
 
+        // the ordering score of the move m points to
+        [[nodiscard]] inline int16_t &score(const Move *m) {
+            return scores[m - head];
+        }
+
         inline void clear() {
             tail = head;
         }
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "scacus/movegen.hpp"
+
+#include <cstdlib>
+
+namespace sc {
+    // Butterfly history: how often each quiet move, by side, from and to square, caused a beta cutoff,
+    // weighted by depth. Moves that get searched without causing a cutoff are penalized.
+    // see https://www.chessprogramming.org/History_Heuristic
+    struct ButterflyHistory {
+        // the scores stay within [-MAX, MAX]: an update moves an entry less the closer it already is
+        static constexpr int MAX = 8192;
+
+        int16_t table[NUM_SIDES][BOARD_SIZE][BOARD_SIZE]{};
+
+        [[nodiscard]] inline int get(const Side side, const Move mov) const {
+            return table[side][mov.src][mov.dst];
+        }
+
+        inline void update(const Side side, const Move mov, const int bonus) {
+            int16_t &entry = table[side][mov.src][mov.dst];
+            entry = static_cast<int16_t>(entry + bonus - entry * std::abs(bonus) / MAX);
+        }
+
+        // halves every score, so that what was learned in earlier iterations fades out
+        inline void decay() {
+            for (auto &side : table)
+                for (auto &from : side)
+                    for (auto &entry : from)
+                        entry /= 2;
+        }
+    };
+
+    // counterMoves[piece][to]: the quiet move that last refuted the opponent moving piece to `to`
+    using CounterMoveTable = Move[NUM_COLORED_PIECE_TYPES][BOARD_SIZE];
+
+    // Hands out the moves of a position one at a time, most promising first. Moves are only generated
+    // once the stages before them run dry, so a cutoff on the transposition table move never generates
+    // anything, and a cutoff on a capture never generates the quiet moves.
+    //   1. the transposition table move, checked for legality
+    //   2. good captures and promotions, by most valuable victim / least valuable attacker
+    //   3. the killer moves of this ply, then the countermove to the opponent's last move
+    //   4. quiet moves, by butterfly history
+    //   5. bad captures, i.e. ones that lose material in the exchange that follows (see_ge())
+    // In check every evasion is generated with the captures, and the picker stops after them.
+    class MovePicker {
+    public:
+        // for the main search. killers: the two killer moves of this ply. moves: where the moves get generated,
+        // which the picker empties first. it has to outlive the picker, and nothing else may use it meanwhile
+        MovePicker(Position &pos, MoveList &moves, Move ttMove, const Move *killers, Move counterMove,
+                   const ButterflyHistory &history);
+
+        // for the quiescence search: only the good captures and promotions (every evasion in check).
+        // The TT move is only used if it is a capture or promotion.
+        MovePicker(Position &pos, MoveList &moves, Move ttMove);
+
+        MovePicker(const MovePicker &) = delete;
+        MovePicker &operator=(const MovePicker &) = delete;
+
+        // the next move to search, or Move{} once there are none left
+        [[nodiscard]] Move next();
+
+    private:
+        enum Stage : uint_fast8_t {
+            TT_MOVE, INIT_CAPTURES, GOOD_CAPTURES, REFUTATIONS, INIT_QUIETS, QUIETS, BAD_CAPTURES, DONE
+        };
+
+        Position &pos;
+        MoveList &moves;
+        Move *cur = nullptr;
+        Move *endBadCaptures = nullptr; // bad captures are moved to the front of the list, up to here
+        Move *endCaptures = nullptr;
+
+        Move ttMove;
+        Move refutations[3]{}; // the killers and the countermove
+        int refutationIndex = 0;
+        const ButterflyHistory *history = nullptr;
+
+        Stage stage = TT_MOVE;
+        bool quiesc;
+        bool inCheck = false;
+
+        // moves the highest scored move in [cur, end) to cur
+        void pick_best(Move *end);
+
+        // insertion sort by score, best first. there are only a few dozen quiet moves at most
+        void sort_descending(Move *begin, Move *end);
+
+        // whether mov was handed out by an earlier stage already
+        [[nodiscard]] inline bool already_tried(const Move mov) const {
+            return mov == ttMove || mov == refutations[0] || mov == refutations[1] || mov == refutations[2];
+        }
+    };
+}
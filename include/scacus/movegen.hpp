@@ -76,19 +76,61 @@ namespace sc {
         return TABLE[sq].table[0]; 
     }
 
+    // Every reversible move, i.e. a piece other than a pawn going from one square to another with nothing else
+    // changing, by how it changes the hash. A move is in one of the two slots cuckoo_h1() and cuckoo_h2()
+    // pick for its key, and the slots of keys that aren't a move's don't hold that key.
+    // see KeyHistory::has_game_cycle()
+    constexpr int CUCKOO_SIZE = 8192;
+    extern uint64_t CUCKOO_KEYS[CUCKOO_SIZE];
+    extern Move CUCKOO_MOVES[CUCKOO_SIZE];
+
+    inline int cuckoo_h1(const uint64_t key) {
+        return key & (CUCKOO_SIZE - 1);
+    }
+
+    inline int cuckoo_h2(const uint64_t key) {
+        return (key >> 16) & (CUCKOO_SIZE - 1);
+    }
+
     void init_movegen();
 
+    // ls may be null unless OUT == GEN_LIST. returns the number of moves in GEN_COUNT mode,
+    // whether there is a move at all in GEN_ANY mode and 0 in GEN_LIST mode.
+    template <Side SIDE, GenType TYPE, GenOutput OUT>
+    int generate_moves(MoveList *ls, Position &pos);
+    extern template int generate_moves<BLACK_SIDE, GEN_ALL, GEN_LIST>(MoveList *, Position &);
+    extern template int generate_moves<WHITE_SIDE, GEN_ALL, GEN_LIST>(MoveList *, Position &);
+    extern template int generate_moves<BLACK_SIDE, GEN_CAPTURES, GEN_LIST>(MoveList *, Position &);
+    extern template int generate_moves<WHITE_SIDE, GEN_CAPTURES, GEN_LIST>(MoveList *, Position &);
+    extern template int generate_moves<BLACK_SIDE, GEN_QUIETS, GEN_LIST>(MoveList *, Position &);
+    extern template int generate_moves<WHITE_SIDE, GEN_QUIETS, GEN_LIST>(MoveList *, Position &);
+    extern template int generate_moves<BLACK_SIDE, GEN_ALL, GEN_COUNT>(MoveList *, Position &);
+    extern template int generate_moves<WHITE_SIDE, GEN_ALL, GEN_COUNT>(MoveList *, Position &);
+    extern template int generate_moves<BLACK_SIDE, GEN_ALL, GEN_ANY>(MoveList *, Position &);
+    extern template int generate_moves<WHITE_SIDE, GEN_ALL, GEN_ANY>(MoveList *, Position &);
+
+    // QUIESC: only captures and promotions, unless in check
     template <Side SIDE, bool QUIESC>
-    void standard_moves(MoveList &ls, Position &pos);
-    extern template void standard_moves<BLACK_SIDE, false>(MoveList &, Position &);
-    extern template void standard_moves<WHITE_SIDE, false>(MoveList &, Position &);
-    extern template void standard_moves<BLACK_SIDE, true>(MoveList &, Position &);
-    extern template void standard_moves<WHITE_SIDE, true>(MoveList &, Position &);
+    inline void standard_moves(MoveList &ls, Position &pos) {
+        generate_moves<SIDE, QUIESC ? GEN_CAPTURES : GEN_ALL, GEN_LIST>(&ls, pos);
+    }
+
+    // number of legal moves SIDE would have, without building the list. cheapest for the side to move, whose
+    // checkers and attacked squares the position has already worked out
+    template <Side SIDE>
+    inline int count_moves(Position &pos) {
+        return generate_moves<SIDE, GEN_ALL, GEN_COUNT>(nullptr, pos);
+    }
 
     // DESIGN TODO: returning a StateInfo * is no longer necessary because of the prev field in StateInfo
-    void make_move(Position &pos, const Move mov, StateInfo *retInfo);
+    // prefetchTT: start loading the new position's transposition table bucket. only worth it in the search
+    void make_move(Position &pos, const Move mov, StateInfo *retInfo, bool prefetchTT = false);
     void unmake_move(Position &pos, const Move mov);
 
+    // passes the turn, for null move pruning. the position can't be in check. prefetchTT: as for make_move
+    void make_null_move(Position &pos, StateInfo *retInfo, bool prefetchTT = false);
+    void unmake_null_move(Position &pos);
+
     template <bool QUIESC>
     inline constexpr void legal_moves_from(MoveList &ls, Position &pos) {
         if (pos.get_turn() == WHITE_SIDE)
@@ -97,12 +139,56 @@ namespace sc {
             standard_moves<BLACK_SIDE, QUIESC>(ls, pos);
     }
 
+    // appends the TYPE moves of the side to move to ls
+    template <GenType TYPE>
+    inline void generate_legal(MoveList &ls, Position &pos) {
+        if (pos.get_turn() == WHITE_SIDE)
+            generate_moves<WHITE_SIDE, TYPE, GEN_LIST>(&ls, pos);
+        else
+            generate_moves<BLACK_SIDE, TYPE, GEN_LIST>(&ls, pos);
+    }
+
     template <bool QUIESC>
     inline MoveList legal_moves_from(Position &pos) {
         MoveList legals(0);
         legal_moves_from<QUIESC>(legals, pos);
         return legals;
     }
-}
 
+    inline int count_legal_moves(Position &pos) {
+        return pos.get_turn() == WHITE_SIDE ? count_moves<WHITE_SIDE>(pos) : count_moves<BLACK_SIDE>(pos);
+    }
+
+    // stops at the first legal move it finds
+    inline bool has_legal_moves(Position &pos) {
+        return pos.get_turn() == WHITE_SIDE ? generate_moves<WHITE_SIDE, GEN_ALL, GEN_ANY>(nullptr, pos)
+                                            : generate_moves<BLACK_SIDE, GEN_ALL, GEN_ANY>(nullptr, pos);
+    }
+
+    // every piece of either side that attacks sq, given the occupancy occ
+    inline Bitboard attackers_to(const Position &pos, const Square sq, const Bitboard occ) {
+        return (pawn_attacks<WHITE_SIDE>(sq) & pos.by_side(BLACK_SIDE) & pos.by_type(PAWN))
+               | (pawn_attacks<BLACK_SIDE>(sq) & pos.by_side(WHITE_SIDE) & pos.by_type(PAWN))
+               | (knight_moves(sq) & pos.by_type(KNIGHT))
+               | (king_moves(sq) & pos.by_type(KING))
+               | (lookup<BISHOP_MAGICS>(sq, occ) & (pos.by_type(BISHOP) | pos.by_type(QUEEN)))
+               | (lookup<ROOK_MAGICS>(sq, occ) & (pos.by_type(ROOK) | pos.by_type(QUEEN)));
+    }
+
+    // whether mov is one of the moves generate_moves<..., GEN_CAPTURES, ...> hands out when not in check
+    inline bool is_noisy(const Position &pos, const Move mov) {
+        return pos.piece_at(mov.dst) != NULL_COLORED_TYPE || mov.typeFlags == EN_PASSANT || mov.typeFlags == PROMOTION;
+    }
 
+    // the pieces giving check to the side to move, worked out from scratch. the position's own copy is
+    // StateInfo::checkers, which is what Position::in_check() looks at
+    inline Bitboard checkers(const Position &pos) {
+        const Side us = pos.get_turn();
+        const Square kingSq = get_lsb(pos.by_side(us) & pos.by_type(KING));
+        return attackers_to(pos, kingSq, pos.by_side(WHITE_SIDE) | pos.by_side(BLACK_SIDE)) & pos.by_side(opposite_side(us));
+    }
+
+    // whether mov is a legal move in pos. meant for moves that come from somewhere other than the
+    // move generator (the transposition table, killers), which might belong to another position entirely
+    [[nodiscard]] bool is_legal(Position &pos, Move mov);
+}
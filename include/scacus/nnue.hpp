@@ -0,0 +1,76 @@
+#pragma once
+
+#include "scacus/bitboard.hpp"
+
+#include <string>
+
+// An optional neural network evaluator, (768 -> HIDDEN)x2 -> 1:
+// - 768 inputs, one for each (piece, square), seen from either side: both the squares and the colours are
+//   flipped for black. When its king is on the e to h files, a side also sees the board mirrored
+//   left to right, so that it always has its king on the queenside.
+// - one accumulator of HIDDEN int16 values for each side, the sum of the weights of the inputs that are on.
+//   moves only turn a few inputs on and off, so these get updated from make_move()'s DirtyPieces instead of
+//   being recomputed. a king crossing the middle of the board flips every input of its side though, and
+//   then that side's accumulator gets rebuilt from the RefreshCache.
+// - the output: both accumulators clipped to [0, QA], side to move first, dotted with the output weights.
+// see https://www.chessprogramming.org/NNUE
+namespace sc::nnue {
+    constexpr int INPUTS = 768;
+    constexpr int HIDDEN = 256;
+
+    // quantization: the accumulators are in units of 1/QA, the output weights of 1/QB, and SCALE turns
+    // the network's output into centipawns
+    constexpr int QA = 255;
+    constexpr int QB = 64;
+    constexpr int SCALE = 400;
+
+    // The network file is just the parameters as little endian int16, in this order:
+    //   feature weights [INPUTS][HIDDEN], feature biases [HIDDEN], output weights [2 * HIDDEN], output bias.
+    // An input is (own piece ? 0 : 384) + piece * 64 + square, pieces going pawn, knight, bishop, rook,
+    // queen, king and squares a1 = 0 to h8 = 63, as seen by the side whose accumulator it is.
+    struct Network {
+        alignas(32) int16_t featureWeights[INPUTS][HIDDEN];
+        alignas(32) int16_t featureBias[HIDDEN];
+        alignas(32) int16_t outputWeights[2 * HIDDEN]; // side to move first
+        int16_t outputBias;
+    };
+
+    // returns false, keeping the network loaded before, if the file can't be read or has the wrong size
+    bool load_network(const std::string &path);
+
+    // whether any network was ever loaded. there is no built-in one
+    [[nodiscard]] bool has_network();
+
+    struct alignas(32) Accumulator {
+        int16_t values[NUM_SIDES][HIDDEN];
+        bool computed[NUM_SIDES];
+    };
+
+    // one entry for each side and mirroring: an accumulator and the board it was computed for. rebuilding an
+    // accumulator then means applying the difference between the entry's board and the current one, which
+    // is mostly a handful of pieces, instead of summing every piece on the board.
+    // see https://www.chessprogramming.org/NNUE#Accumulator_Refresh
+    class RefreshCache {
+    private:
+        struct Entry {
+            alignas(32) int16_t values[HIDDEN];
+            Bitboard byColor[NUM_SIDES];
+            Bitboard byType[NUM_UNCOLORED_PIECE_TYPES];
+        };
+
+        Entry entries[NUM_SIDES][2];
+
+    public:
+        // empties every entry. call it after loading a network
+        void clear();
+
+        void refresh(const Position &pos, Side side, Accumulator &acc);
+    };
+
+    // brings acc[ply], the accumulator of pos, up to date. acc[0..ply) are the accumulators of the positions
+    // before it, whose DirtyPieces lead up to pos.
+    void update(const Position &pos, Accumulator *acc, int ply, RefreshCache &cache);
+
+    // in centipawns, from the side to move's point of view. the accumulator has to be up to date
+    [[nodiscard]] int evaluate(const Accumulator &acc, Side turn);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "scacus/bitboard.hpp"
+
+namespace sc {
+    // what the pawn structure is worth, and the bitboards that came out of working that out. it only
+    // depends on where the pawns are, so it's cached by StateInfo::pawnHash
+    struct PawnEntry {
+        uint64_t key;
+        int16_t mg, eg; // white's point of view, centipawns, like the piece-square scores
+        Bitboard passed[NUM_SIDES];
+        Bitboard attacks[NUM_SIDES]; // squares attacked by the pawns of a side
+
+        // the pawn shield in front of a king also depends on where the king is. it gets recomputed when that
+        // king isn't where it was last time
+        Square kingSq[NUM_SIDES];
+        int16_t shield[NUM_SIDES]; // middlegame bonus, the side's own point of view
+
+        [[nodiscard]] int shield_score(const Position &pos, Side side);
+    };
+
+    // Direct mapped and never shared between threads. The structure hardly changes from one node to the next,
+    // so nearly every probe hits. see https://www.chessprogramming.org/Pawn_Hash_Table
+    class PawnTable {
+    private:
+        static constexpr size_t ENTRIES = 1 << 14;
+
+        PawnEntry entries[ENTRIES]{};
+        uint64_t probes = 0;
+        uint64_t hits = 0;
+
+    public:
+        // the entry for the pawns of pos, evaluating them if they aren't in the table
+        PawnEntry &probe(const Position &pos);
+
+        // the table lives on from one search to the next, its counts are for one search only
+        inline void reset_stats() {
+            probes = hits = 0;
+        }
+
+        [[nodiscard]] inline uint64_t get_probes() const {
+            return probes;
+        }
+
+        [[nodiscard]] inline uint64_t get_hits() const {
+            return hits;
+        }
+    };
+}
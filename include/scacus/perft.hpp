@@ -0,0 +1,21 @@
+#pragma once
+
+#include "scacus/movegen.hpp"
+
+namespace sc {
+    // the number of leaves depth plies below pos. ROOT: also print how many there are below each move
+    template <bool ROOT>
+    uint64_t perft2(Position &pos, int depth);
+    extern template uint64_t perft2<true>(Position &, int);
+    extern template uint64_t perft2<false>(Position &, int);
+
+    void run_perft(Position &pos, int depth);
+
+    // Same output as run_perft, followed by the nodes and speed of every thread. The tree is split into
+    // subtrees that threads take from each other when they run out: a thread works through its own subtrees
+    // newest first, and steals the oldest, i.e. the biggest, of some other thread's.
+    // hashMb: if not 0, the size of a table that remembers the counts of subtrees, so that one reached again
+    // through a transposition doesn't get counted twice. the nodes of a thread are then the ones it counted
+    // or looked up.
+    void run_perft(Position &pos, int depth, unsigned threads, size_t hashMb = 0);
+}
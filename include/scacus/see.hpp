@@ -0,0 +1,25 @@
+#pragma once
+
+#include "scacus/movegen.hpp"
+
+namespace sc {
+    // piece values for static exchange evaluation and capture ordering. roughly centipawns.
+    // the king's doesn't matter: capturing it ends the exchange.
+    constexpr int SEE_VALUE[NUM_UNCOLORED_PIECE_TYPES] = {0, 0, 900, 500, 330, 320, 100};
+
+    // the material mov wins before anything recaptures, promotions included
+    inline int capture_value(const Position &pos, const Move mov) {
+        int gain = mov.typeFlags == EN_PASSANT ? SEE_VALUE[PAWN] : SEE_VALUE[type_of(pos.piece_at(mov.dst))];
+        if (mov.typeFlags == PROMOTION)
+            gain += SEE_VALUE[mov.promote + 2] - SEE_VALUE[PAWN];
+        return gain;
+    }
+
+    // Static exchange evaluation: whether playing mov and then trading off on its destination square,
+    // least valuable attacker first, wins at least `threshold` material for the side making the move.
+    // Either side may stop trading whenever it likes. Sliders behind pieces that come off the square
+    // (x-rays) join in, and pieces pinned to their king don't while the pinner is still on the board.
+    // En passant, promotions and castling count as even trades.
+    // see https://www.chessprogramming.org/Static_Exchange_Evaluation
+    [[nodiscard]] bool see_ge(const Position &pos, Move mov, int threshold = 0);
+}
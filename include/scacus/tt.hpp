@@ -0,0 +1,181 @@
+#pragma once
+
+#include "scacus/bitboard.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+namespace sc {
+
+    constexpr size_t DEFAULT_HASH_MB = 16;
+
+    __extension__ typedef unsigned __int128 uint128_t;
+
+    // a move as 16 bits: src:6 dst:6 promote:2 typeFlags:2. the same as Move's bit fields, but spelled out,
+    // since the compiler decides how those are laid out
+    inline constexpr uint16_t pack_move(const Move mov) {
+        return static_cast<uint16_t>(mov.src | mov.dst << 6 | mov.promote << 12 | mov.typeFlags << 14);
+    }
+
+    inline constexpr Move unpack_move(const uint16_t bits) {
+        return Move{static_cast<Square>(bits & 63), static_cast<Square>((bits >> 6) & 63),
+                    static_cast<PromoteType>((bits >> 12) & 3), static_cast<MoveType>(bits >> 14)};
+    }
+
+    enum Bound : uint8_t {
+        BOUND_NONE = 0, // marks an empty entry
+        BOUND_UPPER,    // search failed low: the score is at most this
+        BOUND_LOWER,    // search failed high: the score is at least this
+        BOUND_EXACT
+    };
+
+    struct TTData {
+        Move move{};
+        int score = 0;
+        int depth = 0;
+        Bound bound = BOUND_NONE;
+    };
+
+    // Lockless transposition table made of 64 byte buckets, each holding several compact entries.
+    // An entry is a 64 bit data word (move, score, depth, bound and age) and a 16 bit check: the low
+    // 16 bits of the hash XOR'd with the data word folded down to 16 bits, see
+    // https://www.chessprogramming.org/Shared_Hash_Table#Lockless
+    // An entry torn by two threads writing at the same time (almost always) fails the check and reads as
+    // a miss, so probes and stores never have to take a lock. Any move read from the table must still be
+    // checked against the legal moves before it is played.
+    class TranspositionTable {
+    private:
+        static constexpr int BUCKET_ENTRIES = 6;
+        static constexpr int AGE_BITS = 6;
+        static constexpr uint8_t AGE_MASK = (1 << AGE_BITS) - 1;
+
+        struct alignas(64) Bucket {
+            std::atomic<uint64_t> data[BUCKET_ENTRIES];
+            std::atomic<uint16_t> check[BUCKET_ENTRIES];
+        };
+        static_assert(sizeof(Bucket) == 64);
+
+        Bucket *table = nullptr;
+        size_t numBuckets = 0;
+        size_t allocSize = 0;
+        bool hugeTlb = false; // true if the table was mmap'd from explicit huge pages
+        bool dirty = false; // true if the table holds garbage and has to be cleared before use
+        uint8_t age = 0; // bumped every search, so entries from previous moves can be told apart
+
+        void free_table();
+
+        // data word layout: move:16 score:32 depth:8 bound:2 age:6
+        static inline constexpr uint64_t pack(const Move mov, const int score, const int depth,
+                                              const Bound bound, const uint8_t age) {
+            return static_cast<uint64_t>(pack_move(mov))
+                   | static_cast<uint64_t>(static_cast<uint32_t>(score)) << 16
+                   | static_cast<uint64_t>(static_cast<uint8_t>(depth)) << 48
+                   | static_cast<uint64_t>(bound | age << 2) << 56;
+        }
+
+        static inline constexpr uint16_t fold(const uint64_t data) {
+            return static_cast<uint16_t>(data ^ data >> 16 ^ data >> 32 ^ data >> 48);
+        }
+
+        static inline constexpr int depth_of(const uint64_t data) { return static_cast<int8_t>(data >> 48); }
+        static inline constexpr Bound bound_of(const uint64_t data) { return static_cast<Bound>((data >> 56) & 3); }
+        static inline constexpr uint8_t age_of(const uint64_t data) { return data >> 58; }
+
+        [[nodiscard]] inline Bucket &bucket(const uint64_t hash) const {
+            // maps the hash onto [0, numBuckets) with a multiply instead of a (slow) modulo.
+            // this uses the high bits of the hash, leaving the low bits for the entry's check.
+            return table[(static_cast<uint128_t>(hash) * numBuckets) >> 64];
+        }
+
+    public:
+        TranspositionTable() = default;
+        ~TranspositionTable();
+
+        TranspositionTable(const TranspositionTable &) = delete;
+        TranspositionTable &operator=(const TranspositionTable &) = delete;
+
+        // (re)allocates the table to hold as many entries as fit in `mb` megabytes, backed by huge pages
+        // where the OS gives us them. The new table is left uninitialized until clear() is called.
+        // None of these are safe to call while a search is running.
+        void resize(size_t mb);
+
+        // zeroes the table, splitting the work over `threads` threads.
+        void clear(unsigned threads);
+
+        // allocates the default size if nothing was allocated yet and clears the table if it holds garbage
+        void prepare(unsigned threads);
+
+        [[nodiscard]] inline bool allocated() const {
+            return table != nullptr;
+        }
+
+        [[nodiscard]] inline size_t size_mb() const {
+            return allocSize >> 20;
+        }
+
+        // call at the start of every search so that entries from earlier searches get replaced first
+        inline void new_search() {
+            age = (age + 1) & AGE_MASK;
+        }
+
+        // starts pulling the bucket for `hash` into cache so that a later probe() doesn't stall on DRAM
+        inline void prefetch(const uint64_t hash) const {
+            __builtin_prefetch(&bucket(hash));
+        }
+
+        inline bool probe(const uint64_t hash, TTData &out) const {
+            const Bucket &b = bucket(hash);
+            const auto key = static_cast<uint16_t>(hash);
+
+            for (int i = 0; i < BUCKET_ENTRIES; i++) {
+                const uint64_t data = b.data[i].load(std::memory_order_relaxed);
+                if ((b.check[i].load(std::memory_order_relaxed) ^ fold(data)) != key || bound_of(data) == BOUND_NONE)
+                    continue;
+
+                out.move = unpack_move(static_cast<uint16_t>(data));
+                out.score = static_cast<int32_t>(data >> 16);
+                out.depth = depth_of(data);
+                out.bound = bound_of(data);
+                return true;
+            }
+
+            return false;
+        }
+
+        // overwrites the entry for this position if it is in the bucket. Otherwise, the entry that is
+        // shallowest after accounting for how many searches ago it was written gets evicted.
+        inline void store(const uint64_t hash, const Move mov, const int score, const int depth, const Bound bound) {
+            Bucket &b = bucket(hash);
+            const auto key = static_cast<uint16_t>(hash);
+
+            int victim = 0, victimWorth = std::numeric_limits<int>::max();
+            for (int i = 0; i < BUCKET_ENTRIES; i++) {
+                const uint64_t data = b.data[i].load(std::memory_order_relaxed);
+
+                if ((b.check[i].load(std::memory_order_relaxed) ^ fold(data)) == key && bound_of(data) != BOUND_NONE) {
+                    // keep a deeper result for the same position unless we now have an exact score
+                    if (bound != BOUND_EXACT && depth < depth_of(data) && age_of(data) == age)
+                        return;
+                    victim = i;
+                    break;
+                }
+
+                // every search that passed since this entry was written is worth 8 plies of depth
+                const int worth = depth_of(data) - 8 * ((age - age_of(data)) & AGE_MASK)
+                                  - (bound_of(data) == BOUND_NONE ? 1024 : 0);
+                if (worth < victimWorth) {
+                    victimWorth = worth;
+                    victim = i;
+                }
+            }
+
+            const uint64_t data = pack(mov, score, std::clamp(depth, -128, 127), bound, age);
+            b.data[victim].store(data, std::memory_order_relaxed);
+            b.check[victim].store(key ^ fold(data), std::memory_order_relaxed);
+        }
+    };
+
+    // the transposition table shared by every search thread. defined in tt.cpp
+    extern TranspositionTable tt;
+}
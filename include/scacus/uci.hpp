@@ -1,64 +1,49 @@
 #pragma once
 
 #include "scacus/engine.hpp"
+#include "scacus/perft.hpp"
 
 #include <thread>
 #include <condition_variable>
 
 namespace sc {
 
-    class UCI;
-    void workerFunc(UCI *);
-
     enum class Variant {
         STANDARD, ANTICHESS,
     };
 
-    template <bool ROOT>
-    uint64_t perft2(Position &pos, int depth);
-    extern template uint64_t perft2<true>(Position &, int);
-    extern template uint64_t perft2<false>(Position &, int);
-
-    void run_perft(Position &pos, int depth);
-
     class UCI {
     public:
         void run();
         void process_cmd(const std::string &line);
 
-        UCI()
-        // : worker{workerFunc, this}
-        {
-            // dbg_dump_position(pos);
-            running = false;
-            workerFunc(this);
+        UCI();
+
+        // the main thread is dedicated to reading stdin. searches run on the engine's own threads and
+        // print their bestmove themselves, so stop/isready/quit get answered while a search is going on.
+        ~UCI() {
+            eng.stop_search();
         }
-//
-//        ~UCI() {
-//            running = false;
-//            mainToWorker.notify_all();
-//            worker.join();
-//        }
     
     private:
+        // sets up the move generator's tables. it has to run before any Position gets set up, our own members
+        // included, so it's the first thing to be initialized
+        static bool init_tables();
+        bool tablesReady = init_tables();
+
         StateInfo states[256];
         StateInfo *stateHead = states;
 
         void position(const std::string &cmd);
+        void setoption(const std::string &cmd);
+        SearchLimits parse_limits(const std::string &cmd);
+        void bench(int ms);
+        void bench_depth(DepthT depth);
+        void bench_time_to_depth(DepthT depth);
+        void bench_tt();
 
-        friend void workerFunc(UCI *);
-        // we use a thread to actually think and stuff!
-        // the main thread simply reads stdin & stdout
-//        std::thread worker;
-//
-//        std::mutex mtx;
-//        std::condition_variable mainToWorker;
-//        std::condition_variable workerToMain;
-        
         Position pos{};
         bool running = true;
-        bool readyok = false;
-        bool go = false;
 
         Variant variant = Variant::STANDARD;
 
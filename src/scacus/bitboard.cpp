@@ -99,6 +99,8 @@ namespace sc {
 //        state = new StateInfo{};
 
         state.hash = 0x927b1a7aed74a025ULL;
+        state.pawnHash = 0;
+        state.psqtMg = state.psqtEg = state.phase = 0;
         for (int i = 0; i < BOARD_SIZE; i++) pieces[i] = NULL_COLORED_TYPE;
         for (int i = 0; i < NUM_UNCOLORED_PIECE_TYPES; i++) byType[i] = 0;
         for (int i = 0; i < NUM_SIDES; i++) byColor[i] = 0;
@@ -163,6 +165,8 @@ namespace sc {
 //            fullmoves = 1;
 //        }
 
+        update_check_info(*this);
+
         if (store) *store = (i + offset);
     }
 
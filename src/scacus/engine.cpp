@@ -2,56 +2,159 @@
 #include <algorithm>
 #include <thread>
 #include <vector>
+#include <syncstream>
+
+#include <x86intrin.h> // __rdtsc
 
 #include "scacus/bitboard.hpp"
+#include "scacus/config.hpp"
+#include "scacus/eval_cache.hpp"
+#include "scacus/key_history.hpp"
+#include "scacus/move_picker.hpp"
+#include "scacus/nnue.hpp"
+#include "scacus/pawns.hpp"
+#include "scacus/see.hpp"
 
-namespace {
-    enum class TransposeType: uint_fast8_t {
-        Full, BetaCut
-    };
+#include <array>
+#include <cmath>
 
-    struct Transposition {
-        uint64_t hash = 0;
-        long strength = 0;
-        sc::ScoreT score = 0;
-        sc::Move bestMove{};
-    };
+namespace sc {
+    // the tapered piece-square score that the position keeps up to date plus the pawn structure, from the side
+    // to move's point of view: the middlegame and endgame scores blended by how much material is left
+    inline static ScoreT evaluate(const Position &pos, PawnEntry &pawns) {
+        const StateInfo &st = pos.get_state();
+        const int mg = st.psqtMg + pawns.mg + pawns.shield_score(pos, WHITE_SIDE) - pawns.shield_score(pos, BLACK_SIDE);
+        const int eg = st.psqtEg + pawns.eg;
+
+        const int phase = std::min(st.phase, MAX_PHASE);
+        const int cp = (mg * phase + eg * (MAX_PHASE - phase)) / MAX_PHASE;
+        return (pos.get_turn() == WHITE_SIDE ? cp : -cp) * PAWN_SCORE / 100;
+    }
 
-    constexpr auto TABLE_SIZE = static_cast<size_t>(12e9 / sizeof(Transposition));
-    Transposition *transTable = nullptr;
+    // rdtsc doesn't wait for earlier loads, so without the fence a cache miss would get billed to whatever
+    // comes after the probe instead of the probe itself
+    inline static uint64_t fenced_rdtsc() {
+        _mm_lfence();
+        return __rdtsc();
+    }
 
-    std::mutex ttMtx;
-}
+    // quiescence results are stored with depth 0 so that they can never satisfy a full-width search
+    inline static int tt_depth(DepthT depth, bool quiesc) {
+        return quiesc ? 0 : depth;
+    }
 
-namespace sc {
-    inline static ScoreT eval_material(Position &pos) {
-        const Side turn = pos.get_turn();
-
-        const Bitboard bishops = pos.by_type(BISHOP);
-        const Bitboard pawns = pos.by_type(PAWN);
-        const Bitboard knights = pos.by_type(KNIGHT);
-        const Bitboard rooks = pos.by_type(ROOK);
-        const Bitboard queens = pos.by_type(QUEEN);
-
-        const Bitboard me = pos.by_side(turn);
-        const Bitboard them = pos.by_side(opposite_side(turn));
-        return (popcnt(me & bishops) - popcnt(them & bishops)) * 33 * PAWN_SCORE / 10
-                + (popcnt(me & knights) - popcnt(them & knights)) * 32 * PAWN_SCORE / 10
-                + (popcnt(me & rooks) - popcnt(them & rooks)) * 5 * PAWN_SCORE
-                + (popcnt(me & queens) - popcnt(them & queens)) * 9 * PAWN_SCORE
-                + (popcnt(me & pawns) - popcnt(them & pawns)) * PAWN_SCORE;
+    // mate scores count plies from the root, but an entry can be reached at any ply, so the table stores
+    // them counting from the entry's own position instead
+    inline static ScoreT score_to_tt(ScoreT score, int ply) {
+        return score >= MATE_BOUND ? score + ply * MATE_STEP : score <= -MATE_BOUND ? score - ply * MATE_STEP : score;
     }
 
-    inline static long tt_strength(DepthT depth, bool quiesc) {
-        return quiesc ? 0 : (4096 + depth);
+    inline static ScoreT score_from_tt(ScoreT score, int ply) {
+        return score >= MATE_BOUND ? score - ply * MATE_STEP : score <= -MATE_BOUND ? score + ply * MATE_STEP : score;
     }
 
+    // "cp <centipawns>" or "mate <moves>", negative if we are the ones getting mated
+    static std::string uci_score(ScoreT score) {
+        if (score >= MATE_BOUND)
+            return "mate " + std::to_string(((-MATE_SCORE - score) / MATE_STEP + 1) / 2);
+        if (score <= -MATE_BOUND)
+            return "mate " + std::to_string(-((score - MATE_SCORE) / MATE_STEP / 2));
+        return "cp " + std::to_string(score * 100 / PAWN_SCORE);
+    }
+
+    // from this depth on, an iteration starts with a window this wide around the score of the last one.
+    // the window grows by half every time the score falls outside
+    constexpr DepthT ASPIRATION_DEPTH = 4;
+    constexpr ScoreT ASPIRATION_DELTA = PAWN_SCORE / 4;
+
+    // the search reports nodes to the engine in batches of this size
+    constexpr uint64_t NODE_FLUSH_INTERVAL = 1024;
+
+    // reverse futility and futility pruning only happen this close to the leaves
+    constexpr DepthT FUTILITY_DEPTH = 3;
+    // how far the static eval can be off by at a given depth. a bit over a pawn per ply
+    inline static ScoreT futility_margin(DepthT depth) {
+        return depth * PAWN_SCORE * 6 / 5;
+    }
+
+    // in the quiescence search, captures that wouldn't get within this of alpha even when nothing
+    // recaptures aren't searched
+    constexpr ScoreT DELTA_MARGIN = 2 * PAWN_SCORE;
+
+    // null move pruning searches this much shallower, plus a ply for every 6 plies of depth
+    constexpr DepthT NULL_MOVE_REDUCTION = 3;
+    // above this depth a null move cutoff is only believed once a search without null moves agrees
+    constexpr DepthT NULL_MOVE_VERIFY_DEPTH = 12;
+
+    // moves before this one (1-based) are never reduced
+    constexpr int LMR_MIN_MOVES = 4;
+
+    // LMR_REDUCTIONS[depth][moveIndex]: the later the move and the deeper the search, the more it's
+    // reduced. grows logarithmically in both
+    static const auto LMR_REDUCTIONS = []() {
+        std::array<std::array<DepthT, 64>, 64> table{};
+        for (int depth = 1; depth < 64; depth++)
+            for (int mov = 1; mov < 64; mov++)
+                table[depth][mov] = static_cast<DepthT>(0.75 + std::log(depth) * std::log(mov) / 2.25);
+        return table;
+    }();
+
+    inline static bool has_non_pawn_material(const Position &pos, const Side side) {
+        return pos.by_side(side) & ~(pos.by_type(PAWN) | pos.by_type(KING));
+    }
+
+    // The parts of a search thread that are too big for its stack. The pawn table and eval cache only depend
+    // on the position (and which evaluation is in use), so they are kept between searches.
+    struct ThreadData {
+        PawnTable pawnTable;
+        EvalCache evalCache;
+
+        // the network's accumulators for the positions from the root to here, computed when first evaluated
+        nnue::Accumulator accumulators[MAX_PLY + 1];
+
+        // the moves of the node at each ply. one node per ply is being searched at any time, so these get
+        // reused instead of every search() frame carrying its own list
+        MoveList moveStack[MAX_PLY + 1];
+    };
+
     class SearchThread {
     private:
         Position *pos;
-        DepthT startDepth;
+        int ply = 0; // distance from the root
+        Move killers[MAX_PLY][2]{}; // quiet moves that caused a beta cutoff at this ply, newest first
+        CounterMoveTable counterMoves{};
+        ButterflyHistory history{};
+        uint64_t cutoffs = 0;
+        uint64_t firstMoveCutoffs = 0;
         uint64_t ttHits = 0;
+        uint64_t nodes = 0;
+        uint64_t ttProbeCycles = 0;
         EngineV2 *eng;
+        bool isMain; // the main thread is the one that keeps an eye on the clock
+        int nullMoveMinPly = 0; // no null moves before this ply, while a null move cutoff is being verified
+
+        // triangular PV table: pvTable[ply][ply..pvLength[ply]) is the best line found from ply on
+        Move pvTable[MAX_PLY][MAX_PLY];
+        int pvLength[MAX_PLY]{};
+        Move prevPv[MAX_PLY]{}; // the principal variation of the last iteration, searched first
+        int prevPvLength = 0;
+        bool followPv = false; // true while the moves made since the root are exactly those of prevPv
+
+        // the hashes of the game's reversible plies before the root, then of the positions from the root to here
+        static constexpr int MAX_GAME_KEYS = 100;
+        KeyHistory<MAX_GAME_KEYS + MAX_PLY + 1> keys;
+        // pliesFromNull[ply]: how many of the keys since the last null move count for repetitions. passing
+        // isn't a move anyone could actually play, so nothing is repeated across it
+        int pliesFromNull[MAX_PLY + 1];
+
+        bool useNnue;
+        nnue::RefreshCache refreshCache;
+
+        // owned by the engine, see ThreadData
+        PawnTable &pawnTable;
+        EvalCache &evalCache;
+        nnue::Accumulator *accumulators;
+        MoveList *moveStack;
 
     public:
 
@@ -59,26 +162,120 @@ namespace sc {
             return ttHits;
         }
 
-        SearchThread(Position *p, DepthT d, EngineV2 *e) : pos(p), startDepth(d), eng(e) {}
+        [[nodiscard]] inline uint64_t getNodes() const {
+            return nodes;
+        }
+
+        [[nodiscard]] inline uint64_t getTTProbeCycles() const {
+            return ttProbeCycles;
+        }
+
+        [[nodiscard]] inline uint64_t getCutoffs() const {
+            return cutoffs;
+        }
 
-        inline ScoreT mateScore(DepthT depth) {
-            return pos->in_check() ? MATE_SCORE + (startDepth - depth) * MATE_STEP : 0;
+        [[nodiscard]] inline uint64_t getFirstMoveCutoffs() const {
+            return firstMoveCutoffs;
         }
 
-        inline ScoreT eval(DepthT depth) {
-            // need to double check if it's mate! TODO: we don't need to full list of legal
-            // moves, so you can implement a more efficient way to check this
-            MoveList ls = legal_moves_from<false>(*pos);
-            if (ls.empty())
-                return mateScore(depth);
+        [[nodiscard]] inline const PawnTable &getPawnTable() const {
+            return pawnTable;
+        }
+
+        [[nodiscard]] inline const EvalCache &getEvalCache() const {
+            return evalCache;
+        }
 
-            MoveList opp(0);
-            if (pos->get_turn() == WHITE_SIDE)
-                standard_moves<BLACK_SIDE, false>(opp, *pos);
-            else
-                standard_moves<WHITE_SIDE, false>(opp, *pos);
+        // called between iterations. killers and countermoves age by getting overwritten instead
+        inline void decay_history() {
+            history.decay();
+        }
+
+        SearchThread(Position *p, EngineV2 *e, bool main, ThreadData &data)
+            : pos(p), eng(e), isMain(main), useNnue(e->options.nnue && nnue::has_network()),
+              pawnTable(data.pawnTable), evalCache(data.evalCache), accumulators(data.accumulators),
+              moveStack(data.moveStack) {
+            pawnTable.reset_stats();
+            evalCache.reset_stats();
+            accumulators[0].computed[BLACK_SIDE] = accumulators[0].computed[WHITE_SIDE] = false;
+            keys.seed(*pos, MAX_GAME_KEYS);
+            pliesFromNull[0] = MAX_GAME_KEYS;
+            if (useNnue)
+                refreshCache.clear();
+        }
+
+        inline void do_move(const Move mov, StateInfo &undo) {
+            make_move(*pos, mov, &undo, PREFETCH_TT);
+            keys.push(pos->get_state().hash);
+            ply++;
+            pliesFromNull[ply] = pliesFromNull[ply - 1] + 1;
+            accumulators[ply].computed[BLACK_SIDE] = accumulators[ply].computed[WHITE_SIDE] = false;
+        }
+
+        inline void undo_move(const Move mov) {
+            unmake_move(*pos, mov);
+            keys.pop();
+            ply--;
+        }
+
+        inline void do_null_move(StateInfo &undo) {
+            make_null_move(*pos, &undo, PREFETCH_TT);
+            keys.push(pos->get_state().hash);
+            ply++;
+            pliesFromNull[ply] = 0;
+            accumulators[ply].computed[BLACK_SIDE] = accumulators[ply].computed[WHITE_SIDE] = false;
+        }
 
-            return eval_material(*pos) + static_cast<ScoreT>(ls.size() - opp.size()) * MOBILITY_VALUE;
+        inline void undo_null_move() {
+            unmake_null_move(*pos);
+            keys.pop();
+            ply--;
+        }
+
+        // mov beat alpha at a PV node: the line from here on is mov followed by the line of the child
+        inline void update_pv(const Move mov) {
+            pvTable[ply][ply] = mov;
+            for (int i = ply + 1; i < pvLength[ply + 1]; i++)
+                pvTable[ply][i] = pvTable[ply + 1][i];
+            pvLength[ply] = std::max(pvLength[ply + 1], ply + 1);
+        }
+
+        // keeps the principal variation of the iteration that just finished, to be searched first next time
+        inline void save_pv() {
+            prevPvLength = pvLength[0];
+            std::copy(pvTable[0], pvTable[0] + prevPvLength, prevPv);
+        }
+
+        [[nodiscard]] inline std::vector<Move> pv_line() const {
+            return std::vector<Move>(prevPv, prevPv + prevPvLength);
+        }
+
+        // searches with `depth` plies left, dropping into the quiescence search when there are none
+        inline ScoreT search_depth(ScoreT alpha, ScoreT beta, DepthT depth) {
+            return depth <= QUIESC_DEPTH ? search<true>(alpha, beta, depth) : search<false>(alpha, beta, depth);
+        }
+
+        // the score of a position without legal moves. mates closer to the root score better
+        inline ScoreT mateScore(const bool inCheck) const {
+            return inCheck ? MATE_SCORE + ply * MATE_STEP : 0;
+        }
+
+        // doesn't know about mate: the search finds those by running out of moves
+        inline ScoreT eval() {
+            const uint64_t hash = pos->get_state().hash;
+            ScoreT score;
+            if (evalCache.probe(hash, score))
+                return score;
+
+            if (useNnue) {
+                nnue::update(*pos, accumulators, ply, refreshCache);
+                score = nnue::evaluate(accumulators[ply], pos->get_turn()) * PAWN_SCORE / 100;
+            } else {
+                score = evaluate(*pos, pawnTable.probe(*pos));
+            }
+
+            evalCache.store(hash, score);
+            return score;
         }
 
         #define USE_TT 1
@@ -86,200 +283,560 @@ namespace sc {
         template <bool QUIESC>
         ScoreT search(ScoreT alpha, ScoreT beta, DepthT depth) {
             Move best{};
+            if (++nodes % NODE_FLUSH_INTERVAL == 0) {
+                eng->nodes.fetch_add(NODE_FLUSH_INTERVAL, std::memory_order_relaxed);
+                if (isMain)
+                    eng->check_hard_limits();
+            }
+
+            // the PV starts out empty here, whichever way we return. the parent copies it into its own
+            pvLength[ply] = ply;
+
+            // only needs guarding in long quiescence searches at the very end of a deep main search
+            if (ply >= MAX_PLY - 1)
+                return eval();
+
+            // PV nodes are searched with an open window, everything else with a null window. the PV is the
+            // line whose exact score we are after, so its nodes aren't pruned as aggressively.
+            const bool pvNode = beta - 1 > alpha; // not beta - alpha, which overflows for the full window
+
+            const ScoreT origAlpha = alpha;
+            const int ttDepth = tt_depth(depth, QUIESC);
+
+            // before the TT: a stored score was found with some other history, and doesn't know that this
+            // position is a draw along the current one
+            const int repetitionWindow = std::min(pos->get_state().halfmoves, pliesFromNull[ply]);
+            // the halfmove clock counts plies, so the fifty move rule is at 100
+            const bool canForceDraw = pos->get_state().halfmoves >= 100 || keys.is_repetition(repetitionWindow);
+
+            // being mated still takes precedence over the draw
+            if (canForceDraw)
+                return has_legal_moves(*pos) ? 0 : mateScore(pos->in_check());
+
+            // we can go back to a position from before, so this one is worth at least a draw
+            if (alpha < 0 && keys.has_game_cycle(*pos, repetitionWindow, ply)) {
+                alpha = 0;
+                if (alpha >= beta)
+                    return alpha;
+            }
 
-            Transposition *tt;
             if (USE_TT) {
-                std::lock_guard<std::mutex> lg(ttMtx);
-                tt = &transTable[pos->get_state().hash % TABLE_SIZE];
-                // // either the tt is in a higher mode OR (higher depth and same mode)
-                if (tt->hash == pos->get_state().hash) {
+                TTData entry;
+                const uint64_t probeStart = TIME_TT_PROBES ? fenced_rdtsc() : 0;
+                const bool hit = tt.probe(pos->get_state().hash, entry);
+                if (TIME_TT_PROBES)
+                    ttProbeCycles += fenced_rdtsc() - probeStart;
+
+                // the entry has to be searched at least as deep, and its bound has to tell us enough
+                // cutting off at PV nodes would cut the PV short
+                if (hit) {
                     ttHits++;
-                    if (tt_strength(depth, QUIESC) <= tt->strength)
-                        return tt->score;
-                    best = tt->bestMove;
+                    const ScoreT ttScore = score_from_tt(entry.score, ply);
+                    if (!pvNode && entry.depth >= ttDepth && (entry.bound == BOUND_EXACT
+                                                   || (entry.bound == BOUND_LOWER && ttScore >= beta)
+                                                   || (entry.bound == BOUND_UPPER && ttScore <= alpha)))
+                        return ttScore;
+                    best = entry.move;
                 }
             }
 
-            MoveList ls = legal_moves_from<QUIESC>(*pos);
-            if (!QUIESC && depth > 2)
-                order_moves(ls, best);
+            // along the last iteration's principal variation, its move goes first
+            Move pvMove{};
+            if (followPv) {
+                if (ply < prevPvLength)
+                    best = pvMove = prevPv[ply];
+                else
+                    followPv = false;
+            }
 
-            const bool canForceDraw = pos->get_state().halfmoves >= 50 || pos->get_state().reps;
+            const bool inCheck = pos->in_check();
+            const SearchOptions &opts = eng->options;
 
+            ScoreT value = MIN_SCORE;
+            ScoreT staticEval = MIN_SCORE; // only for pruning decisions. not set in check
             if (QUIESC) {
-                ScoreT ev = canForceDraw ? 0 : eval(depth);
-                if (ev >= beta || ls.empty() || !eng->is_running() /* || depth <= 0 */ )
-                    return ev;
-                alpha = std::max(alpha, ev);
+                // standing pat is an option unless in check, where every evasion gets searched instead
+                if (!inCheck) {
+                    const ScoreT ev = eval();
+                    if (ev >= beta || !eng->is_running())
+                        return ev;
+                    alpha = std::max(alpha, ev);
+                    value = staticEval = ev;
+                } else if (!eng->is_running()) {
+                    return eval();
+                }
             } else {
-                if (ls.empty())
-                    return mateScore(depth);
-
-                if (canForceDraw) return 0;
-
                 if (depth <= QUIESC_DEPTH || !eng->is_running()) {
                     return search<true>(alpha, beta, depth - 1);
                 }
+
+                if (!inCheck)
+                    staticEval = eval();
+
+                // reverse futility pruning: so far above beta that even losing some of it won't change that
+                if (opts.futility && !pvNode && !inCheck && depth <= FUTILITY_DEPTH && !is_mate_score(beta)
+                    && staticEval - futility_margin(depth) >= beta)
+                    return staticEval;
+
+                // null move pruning: if we are still above beta after passing, a real move will (almost) always
+                // be too. that fails in zugzwang, where every move makes things worse: don't try it without
+                // pieces to move, nor twice in a row, and verify the cutoffs of deep searches.
+                if (opts.nullMove && !pvNode && !inCheck && depth >= 2 && ply >= nullMoveMinPly && staticEval >= beta
+                    && !is_mate_score(beta) && pos->get_state().prevMove != Move{}
+                    && has_non_pawn_material(*pos, pos->get_turn())) {
+                    const DepthT nullDepth = depth - 1 - NULL_MOVE_REDUCTION - depth / 6;
+
+                    StateInfo undo;
+                    do_null_move(undo);
+                    ScoreT score = -search_depth(-beta, -beta + 1, nullDepth);
+                    undo_null_move();
+
+                    if (score >= beta && eng->is_running()) {
+                        // a mate we found by passing isn't a proven one
+                        if (is_mate_score(score))
+                            score = beta;
+
+                        if (depth < NULL_MOVE_VERIFY_DEPTH || nullMoveMinPly)
+                            return score;
+
+                        nullMoveMinPly = ply + 3 * nullDepth / 4;
+                        const ScoreT verified = search_depth(beta - 1, beta, nullDepth);
+                        nullMoveMinPly = 0;
+
+                        if (verified >= beta)
+                            return score;
+                    }
+                }
             }
 
-            ScoreT value = MIN_SCORE;
-            for (const auto &mov: ls) {
+            // the reply that refuted the opponent's last move last time, if it was quiet. at the root and
+            // after a null move there is no last move to reply to
+            const Move prev = pos->get_state().prevMove;
+            Move *counterMove = prev != Move{} ? &counterMoves[pos->piece_at(prev.dst)][prev.dst] : nullptr;
+
+            MovePicker picker = QUIESC ? MovePicker(*pos, moveStack[ply], best)
+                                       : MovePicker(*pos, moveStack[ply], best, killers[ply],
+                                                    counterMove ? *counterMove : Move{}, history);
+            int moveCount = 0;
+
+            // the quiet moves that were searched without causing a cutoff, to be penalized if something does
+            Move quietsTried[64];
+            int numQuietsTried = 0;
+
+            for (Move mov; (mov = picker.next()) != Move{};) {
+                moveCount++;
+                const bool quiet = !QUIESC && !is_noisy(*pos, mov);
+
+                // delta pruning: even winning the piece for free wouldn't get us close to alpha
+                if (QUIESC && opts.deltaPruning && !inCheck
+                    && staticEval + capture_value(*pos, mov) * PAWN_SCORE / 100 + DELTA_MARGIN <= alpha)
+                    continue;
+
                 StateInfo undo;
-                make_move(*pos, mov, &undo);
+                do_move(mov, undo);
+                const bool givesCheck = !QUIESC && pos->in_check();
+
+                // futility pruning: near the leaves, a quiet move won't make up for being far below alpha.
+                // the first move is always searched so that there is something to return
+                if (!QUIESC && opts.futility && quiet && !inCheck && !givesCheck && moveCount > 1
+                    && depth <= FUTILITY_DEPTH && !is_mate_score(alpha)
+                    && staticEval + futility_margin(depth) <= alpha) {
+                    undo_move(mov);
+                    value = std::max(value, staticEval + futility_margin(depth));
+                    continue;
+                }
+
+                followPv = followPv && mov == pvMove;
 
                 ScoreT score;
-                if (QUIESC || depth <= QUIESC_DEPTH + 1)
+                if (QUIESC) {
                     score = -search<true>(-beta, -alpha, depth - 1);
-                else
-                    score = -search<false>(-beta, -alpha, depth - 1);
+                } else if (moveCount == 1) {
+                    score = -search_depth(-beta, -alpha, depth - 1);
+                } else {
+                    // principal variation search: the first move is most likely the best, so the others only
+                    // get a null window search to prove that they are worse. the few that turn out not to be
+                    // get searched again with the full window.
+                    DepthT reduced = depth - 1;
+
+                    // late move reductions: with good move ordering, late quiet moves hardly ever turn out best,
+                    // so the null window search of those is shallower too. less so on the PV
+                    if (opts.lmr && depth >= 3 && moveCount >= LMR_MIN_MOVES && quiet && !inCheck && !givesCheck)
+                        reduced = std::clamp(depth - 1 - LMR_REDUCTIONS[std::min(depth, 63)][std::min(moveCount, 63)]
+                                             + pvNode, 1, depth - 1);
+
+                    score = -search_depth(-alpha - 1, -alpha, reduced);
+                    if (score > alpha && reduced < depth - 1)
+                        score = -search_depth(-alpha - 1, -alpha, depth - 1);
+                    if (score > alpha && score < beta)
+                        score = -search_depth(-beta, -alpha, depth - 1);
+                }
+
+                undo_move(mov);
+
+                // only the first move made here can have been on the previous PV
+                followPv = false;
 
                 if (score > value) {
                     value = score;
                     best = mov;
+                    if (pvNode && score > alpha)
+                        update_pv(mov);
                 }
 
                 alpha = std::max(value, alpha);
 
-                unmake_move(*pos, mov);
-
                 if (value >= beta) {
-                    return value;
+                    if (!QUIESC) {
+                        cutoffs++;
+                        firstMoveCutoffs += moveCount == 1;
+                    }
+                    if (quiet)
+                        update_quiet_stats(mov, depth, quietsTried, numQuietsTried, counterMove);
+                    break;
                 }
+
+                if (quiet && numQuietsTried < 64)
+                    quietsTried[numQuietsTried++] = mov;
             }
 
-            if (USE_TT) {
-                std::lock_guard<std::mutex> lg(ttMtx);
-
-                // either we are in a higher mode OR we have higher depth in the same mode
-                if (tt->hash != pos->get_state().hash || tt_strength(depth, QUIESC) >= tt->strength) {
-                    tt->strength = tt_strength(depth, QUIESC);
-                    tt->score = value;
-                    tt->hash = pos->get_state().hash;
-                    tt->bestMove = best;
-                }
+            // checkmate or stalemate. the quiescence search only sees all moves when in check, so it can only
+            // tell a mate
+            if (moveCount == 0 && (!QUIESC || inCheck))
+                return mateScore(inCheck);
+
+            // the scores of an interrupted search are garbage, so don't let them into the table
+            if (USE_TT && eng->is_running()) {
+                const Bound bound = value >= beta ? BOUND_LOWER : value > origAlpha ? BOUND_EXACT : BOUND_UPPER;
+                tt.store(pos->get_state().hash, best, score_to_tt(value, ply), ttDepth, bound);
             }
 
-            return QUIESC ? alpha : value; // or QUIESC ? alpha : value;
+            return value;
         }
 
-        inline void order_moves(MoveList &ls, Move best) {
-            for (auto &m : ls) {
-                if (m == best)
-                    m.ranking = std::numeric_limits<int_fast16_t>::max();
-                else if (pos->piece_at(m.dst) != NULL_COLORED_TYPE || m.typeFlags == EN_PASSANT) {
-                    // adding | 8 makes the black and white pieces the same.
-                    m.ranking = 4096 + pos->piece_at(m.dst | 8) - pos->piece_at(m.src | 8);
-                } else if (m.typeFlags == PROMOTION) {
-                    m.ranking = std::numeric_limits<int_fast16_t>::max() - 2 - m.promote;
+        // searches every root move, the first with the full window and the others with PVS. returns the best
+        // score; if it's above alpha, bestIndex is the move that got it, and the PV starts with that move.
+        ScoreT search_root(const std::vector<Move> &rootMoves, ScoreT alpha, const ScoreT beta, const DepthT depth,
+                           size_t &bestIndex) {
+            ScoreT value = MIN_SCORE;
+            pvLength[0] = 0;
+
+            for (size_t i = 0; i < rootMoves.size() && eng->is_running(); i++) {
+                const Move mov = rootMoves[i];
+                followPv = i == 0 && prevPvLength > 0 && mov == prevPv[0];
+
+                StateInfo undo;
+                do_move(mov, undo);
+                ScoreT score;
+                if (i == 0) {
+                    score = -search_depth(-beta, -alpha, depth - 1);
+                } else {
+                    score = -search_depth(-alpha - 1, -alpha, depth - 1);
+                    if (score > alpha && score < beta)
+                        score = -search_depth(-beta, -alpha, depth - 1);
+                }
+                undo_move(mov);
+                followPv = false;
+
+                value = std::max(value, score);
+                if (score > alpha) {
+                    alpha = score;
+                    bestIndex = i;
+                    update_pv(mov);
+                    if (alpha >= beta)
+                        break;
                 }
             }
 
-            std::sort(ls.begin(), ls.end());
+            return value;
+        }
+
+        // mov caused a beta cutoff at depth after the quiet moves in tried failed to. counterMove: where the reply
+        // to the opponent's last move goes, null if there was no last move
+        inline void update_quiet_stats(const Move mov, const DepthT depth, const Move *tried, const int numTried,
+                                       Move *counterMove) {
+            if (killers[ply][0] != mov) {
+                killers[ply][1] = killers[ply][0];
+                killers[ply][0] = mov;
+            }
+            if (counterMove)
+                *counterMove = mov;
+
+            const Side us = pos->get_turn();
+            const int bonus = std::min(depth * depth, 400);
+            history.update(us, mov, bonus);
+            for (int i = 0; i < numTried; i++)
+                history.update(us, tried[i], -bonus);
         }
     };
 
 
-    void workerFunc(EngineV2 *eng) {
+    // Lazy SMP helpers skip some depths so that they don't all search the same iteration in lockstep.
+    // thread `id` > 0 skips depth d if ((d + SKIP_PHASE[i]) / SKIP_SIZE[i]) is odd, i = (id - 1) % 20.
+    // taken from Stockfish 9, see https://www.chessprogramming.org/Lazy_SMP
+    constexpr int SKIP_SIZE[] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+    constexpr int SKIP_PHASE[] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+    inline static bool skip_depth(unsigned id, DepthT depth) {
+        if (id == 0) return false;
+        const auto i = (id - 1) % 20;
+        return ((depth + SKIP_PHASE[i]) / SKIP_SIZE[i]) % 2 != 0;
+    }
+
+    // Every thread runs iterative deepening over the whole root, and they only talk through the
+    // transposition table. Thread 0 is the main thread: the engine's result is whatever the main thread
+    // got out of the last iteration it finished, which is also what decides when a depth is complete.
+    void workerFunc(EngineV2 *eng, unsigned id) {
         Position cpos = *eng->pos;
+        SearchThread me{&cpos, eng, id == 0, *eng->threadData[id]};
 
-        while (eng->is_running()) {
-            SearchTask task;
-            {
-                std::unique_lock<std::mutex> lg(eng->taskMtx);
-                eng->taskCv.wait(lg, [&]() { return !eng->is_running() || !eng->tasks.empty(); });
-                if (!eng->is_running()) return;
+        std::vector<Move> rootMoves;
+        for (const auto &mov : legal_moves_from<false>(cpos))
+            rootMoves.push_back(mov);
+
+        int stableIterations = 0; // how many iterations in a row the best move stayed the same
+        ScoreT score = 0; // of the last iteration
+
+        for (DepthT depth = 1; depth <= eng->limits.depth && eng->is_running() && !rootMoves.empty(); depth++) {
+            if (skip_depth(id, depth))
+                continue;
+
+            me.decay_history();
+            const Move prevBest = rootMoves[0];
 
-                task = eng->tasks.top();
-                eng->tasks.pop();
+            // aspiration windows: the score usually doesn't move much from one iteration to the next, and
+            // a narrow window makes for a lot more cutoffs. if the score ends up outside, widen and retry
+            ScoreT delta = ASPIRATION_DELTA;
+            ScoreT alpha = -MAX_SCORE, beta = MAX_SCORE;
+            if (depth >= ASPIRATION_DEPTH && !is_mate_score(score)) {
+                alpha = std::max(score - delta, -MAX_SCORE);
+                beta = std::min(score + delta, MAX_SCORE);
             }
-            // std::cout << "info string exec " << task.mov.long_alg_notation() << " rank " << task.score / (double) PAWN_SCORE << " depth " << task.depth << '\n';
 
-            SearchThread me{&cpos, static_cast<DepthT>(task.depth), eng};
+            while (true) {
+                size_t bestIndex = 0;
+                score = me.search_root(rootMoves, alpha, beta, depth, bestIndex);
+                if (!eng->is_running())
+                    break;
+
+                // search the best move first, in the next iteration or in the re-search
+                std::rotate(rootMoves.begin(), rootMoves.begin() + bestIndex, rootMoves.begin() + bestIndex + 1);
+
+                if (score <= alpha) {
+                    beta = static_cast<ScoreT>((static_cast<int64_t>(alpha) + beta) / 2);
+                    alpha = is_mate_score(score) ? -MAX_SCORE : std::max(score - delta, -MAX_SCORE);
+                } else if (score >= beta) {
+                    beta = is_mate_score(score) ? MAX_SCORE : std::min(score + delta, MAX_SCORE);
+                } else {
+                    break;
+                }
 
-            StateInfo undo;
-            make_move(cpos, task.mov, &undo);
-            const ScoreT score = -me.search<false>(MIN_SCORE, MAX_SCORE, task.depth - 1);
+                delta += delta / 2;
+            }
 
-            std::cout << "info string mov " << task.mov.long_alg_notation() << " score " 
-                      << (double) score / PAWN_SCORE << " ttHits = " << me.getTTHits() 
-                      << " depth " << task.depth << '\n';
+            if (!eng->is_running())
+                break;
 
-            unmake_move(cpos, task.mov);
+            me.save_pv();
+            stableIterations = rootMoves[0] == prevBest ? stableIterations + 1 : 0;
 
-            {
-                std::lock_guard<std::mutex> lg(eng->bestMtx);
-
-                // if we're searching a greater depth, 
-                // we must have completed the previous depth and can thus swap
-                // prelim with the true line.
-                // TODO: This is a scuffed way to detect finishing searching a depth.
-                // I think that there is still an edge case where we can get unlucky and miss out
-                // on a search depth if the last task running is the last task for the depth
-                if (task.depth > eng->search_depth) {
-                    std::cout << "info string depth complete: " << eng->search_depth << '\n';
-                    eng->true_line = eng->prelim_line;
-                    eng->prelim_line = EngineV2::EngineLine{};
-                    eng->search_depth = task.depth;
+            if (id == 0) {
+                const std::vector<Move> pv = me.pv_line();
+                {
+                    std::lock_guard<std::mutex> lg(eng->bestMtx);
+                    eng->true_line.best_mov = rootMoves[0];
+                    eng->true_line.best_score = score;
+                    eng->true_line.pv = pv;
+                    eng->search_depth = depth;
                 }
 
-                if (!eng->is_running())
-                    return;
+                const auto elapsed = eng->elapsed_ms();
+                // per mille of this thread's cutoffs that came from the first move
+                const uint64_t firstCut = me.getFirstMoveCutoffs() * 1000 / std::max<uint64_t>(1, me.getCutoffs());
 
-                // PROBLEM: Low depths can produce absurdly high scores!
-                if (score > eng->prelim_line.best_score) {
-                    eng->prelim_line.best_score = score;
-                    eng->prelim_line.best_mov = task.mov;
-                }
-            }
+                std::string pvStr;
+                for (const Move mov : pv)
+                    pvStr += " " + mov.long_alg_notation();
 
-            task.depth++;
-            task.score = score;
+                std::osyncstream(std::cout) << "info depth " << depth << " score " << uci_score(score)
+                          << " nodes " << eng->node_count() << " nps " << eng->node_count() * 1000 / (elapsed + 1)
+                          << " time " << elapsed << " tthits " << me.getTTHits()
+                          << " firstcut " << firstCut / 10 << '.' << firstCut % 10
+                          << " pv" << pvStr << std::endl;
 
+                if (eng->should_stop_iterating(stableIterations, rootMoves.size()))
+                    break;
+            }
+        }
+
+        eng->nodes.fetch_add(me.getNodes() % NODE_FLUSH_INTERVAL, std::memory_order_relaxed);
+        eng->ttProbeCycles.fetch_add(me.getTTProbeCycles(), std::memory_order_relaxed);
+        eng->cutoffs.fetch_add(me.getCutoffs(), std::memory_order_relaxed);
+        eng->firstMoveCutoffs.fetch_add(me.getFirstMoveCutoffs(), std::memory_order_relaxed);
+        eng->pawnProbes.fetch_add(me.getPawnTable().get_probes(), std::memory_order_relaxed);
+        eng->pawnHits.fetch_add(me.getPawnTable().get_hits(), std::memory_order_relaxed);
+        eng->evalProbes.fetch_add(me.getEvalCache().get_probes(), std::memory_order_relaxed);
+        eng->evalHits.fetch_add(me.getEvalCache().get_hits(), std::memory_order_relaxed);
+
+        // the main thread finishing means the search is over, even if it was a depth limit that stopped it
+        if (id == 0) {
+            // we're not allowed to answer before ponderhit or stop, even if there is nothing left to search.
+            // an infinite search only ever ends with stop
             {
-                std::unique_lock<std::mutex> lg(eng->taskMtx);
-                eng->tasks.push(task);
+                std::unique_lock<std::mutex> lg(eng->ponderMtx);
+                eng->ponderCv.wait(lg, [&]() {
+                    return !(eng->pondering || eng->limits.infinite) || !eng->is_running();
+                });
             }
 
-            eng->taskCv.notify_one();
+            eng->running = false;
+            if (eng->onBestMove)
+                eng->onBestMove(eng->best_move(), eng->ponder_move());
         }
     }
 
-    void EngineV2::start_search(int maxDepth) {
-        if (transTable == nullptr)
-            transTable = new Transposition[TABLE_SIZE];
+    void EngineV2::init_time_limits() {
+        const Side us = pos->get_turn();
+        softLimit = hardLimit = 0;
 
-        MoveList ls = legal_moves_from<false>(*pos);
+        if (limits.infinite)
+            return;
 
-        while (!tasks.empty())
-            tasks.pop();
+        if (limits.movetime) {
+            softLimit = hardLimit = std::max<int64_t>(1, limits.movetime - moveOverhead);
+            return;
+        }
+
+        if (!limits.time[us])
+            return;
+
+        // pretend there are always at least a few moves to go. running out with a long game ahead is much
+        // worse than leaving some time on the clock when the game ends
+        const int64_t movesToGo = limits.movestogo ? std::min(limits.movestogo, 40) : 30;
+        const int64_t timeLeft = std::max<int64_t>(1, limits.time[us] - moveOverhead);
+
+        softLimit = timeLeft / movesToGo + limits.inc[us] * 3 / 4;
+        hardLimit = std::min(softLimit * 5, timeLeft * 2 / 5 + limits.inc[us] / 2);
+
+        // never plan to use more than what's left on the clock
+        hardLimit = std::clamp<int64_t>(hardLimit, 1, timeLeft * 9 / 10);
+        softLimit = std::clamp<int64_t>(softLimit, 1, hardLimit);
+    }
+
+    void EngineV2::check_hard_limits() {
+        if (pondering)
+            return;
+
+        if ((hardLimit && elapsed_ms() >= hardLimit) || (limits.nodes && node_count() >= limits.nodes))
+            running = false;
+    }
+
+    bool EngineV2::should_stop_iterating(int stableIterations, size_t numRootMoves) const {
+        if (pondering || !limits.uses_clock(pos->get_turn()))
+            return false;
+
+        // there is nothing to think about
+        if (numRootMoves == 1)
+            return true;
+
+        if (limits.movetime || !softLimit)
+            return false;
+
+        // spend less time when the best move keeps coming out on top, and more when it just changed.
+        // the next iteration takes several times longer than this one, so stop well before the soft limit
+        const double stability = stableIterations == 0 ? 1.4 : stableIterations < 3 ? 1.0 : 0.6;
+        return elapsed_ms() >= static_cast<int64_t>(softLimit * stability * 0.6);
+    }
+
+    void EngineV2::start_search(const SearchLimits &lim) {
+        // the threads of the last search might still be using the table
+        wait_search();
+        startTime = Clock::now();
+
+        // normally a no-op: the table is set up by isready/ucinewgame before the first go
+        tt.prepare(numThreads);
+        tt.new_search();
 
-        workers.clear();
         running = true;
-        prelim_line = EngineLine{};
+        pondering = lim.ponder;
+        limits = lim;
+        init_time_limits();
         true_line = EngineLine{};
         search_depth = 0;
+        nodes = 0;
+        ttProbeCycles = 0;
+        cutoffs = 0;
+        firstMoveCutoffs = 0;
+        pawnProbes = 0;
+        pawnHits = 0;
+        evalProbes = 0;
+        evalHits = 0;
+
+        // have something to play even if we get stopped before finishing depth 1
+        MoveList ls = legal_moves_from<false>(*pos);
+        if (!ls.empty())
+            true_line.best_mov = ls.at(0);
 
-        for (const auto &mov : ls) {
-            SearchTask task{};
-            task.mov = mov;
-            task.score = 0;
-            task.depth = QUIESC_DEPTH + 2;
+        threadData.resize(numThreads);
+        for (auto &data : threadData)
+            if (!data)
+                data = std::make_unique<ThreadData>();
 
-            tasks.push(task);
-        }
+        for (unsigned i = 0; i < numThreads; i++)
+            workers.push_back(std::thread(workerFunc, this, i));
+    }
 
-        for (unsigned i = 0; i < std::thread::hardware_concurrency(); i++)
-            workers.push_back(std::thread(workerFunc, this));
+    // out of line, where ThreadData is complete
+    EngineV2::EngineV2() = default;
+    EngineV2::~EngineV2() = default;
+
+    void EngineV2::clear_eval_caches() {
+        threadData.clear();
     }
 
     void EngineV2::stop_search() {
-        running = false;
-        taskCv.notify_all();
+        {
+            std::lock_guard<std::mutex> lg(ponderMtx);
+            running = false;
+        }
+        ponderCv.notify_all();
+        wait_search();
+    }
+
+    void EngineV2::ponderhit() {
+        // the clock starts now, so whatever we searched while pondering was free
+        startTime = Clock::now();
+        {
+            std::lock_guard<std::mutex> lg(ponderMtx);
+            pondering = false;
+        }
+        ponderCv.notify_all();
+    }
+
+    Move EngineV2::ponder_move() const {
+        const Move best = best_move();
+        if (best == Move{})
+            return Move{};
+
+        // only the main thread writes the PV, and it's the one calling this
+        if (true_line.pv.size() >= 2 && true_line.pv[0] == best)
+            return true_line.pv[1];
+
+        Position cpos = *pos;
+        StateInfo undo;
+        make_move(cpos, best, &undo);
+
+        TTData entry;
+        if (!tt.probe(cpos.get_state().hash, entry))
+            return Move{};
+
+        // the entry might belong to another position with the same key bits
+        return is_legal(cpos, entry.move) ? entry.move : Move{};
+    }
+
+    void EngineV2::wait_search() {
         for (auto &thread : workers)
             thread.join();
         workers.clear();
-
-        while (!tasks.empty())
-            tasks.pop();
     }
-}
\ No newline at end of file
+}
@@ -1,4 +1,5 @@
 #include "scacus/movegen.hpp"
+#include "scacus/tt.hpp"
 
 namespace sc::makeimpl {
     using namespace sc;
@@ -67,7 +68,7 @@ namespace sc::makeimpl {
 namespace sc {
     using namespace makeimpl;
 
-    void make_move(Position &pos, const Move mov, StateInfo *ret) {
+    void make_move(Position &pos, const Move mov, StateInfo *ret, const bool prefetchTT) {
         // make a copy of the current state
         // the current state will be updated into oblivion.
 //        StateInfo *ret = new StateInfo{*pos.state};
@@ -83,11 +84,19 @@ namespace sc {
 
         pos.state.enPassantTarget = NULL_SQUARE;
 
+        DirtyPieces &dirty = pos.state.dirty;
+        dirty = DirtyPieces{};
+
         switch (mov.typeFlags) {
             case NORMAL: {
                 pos.state.capturedPiece = pos.pieces[mov.dst];
 
                 Type movedType = type_of(pos.pieces[mov.src]);
+                dirty.remove(pos.pieces[mov.src], mov.src);
+                dirty.add(pos.pieces[mov.src], mov.dst);
+                if (pos.state.capturedPiece != NULL_COLORED_TYPE)
+                    dirty.remove(pos.state.capturedPiece, mov.dst);
+
                 pos.clear(mov.dst);
                 pos.set(mov.dst, movedType, pos.turn);
                 pos.clear(mov.src);
@@ -118,6 +127,11 @@ namespace sc {
 
                 auto [targetRook, rookNewDst] = PositionFriend::castle_info(mov);
 
+                dirty.remove(new_ColoredType(KING, pos.turn), mov.src);
+                dirty.add(new_ColoredType(KING, pos.turn), mov.dst);
+                dirty.remove(new_ColoredType(ROOK, pos.turn), targetRook);
+                dirty.add(new_ColoredType(ROOK, pos.turn), rookNewDst);
+
                 pos.clear(targetRook);
                 pos.set(rookNewDst, ROOK, pos.turn);
 
@@ -128,6 +142,10 @@ namespace sc {
                 // use enPassantTarget from ret: pos.state.enPassant target has already been set to null.
                 Square capturedPawn = ret->enPassantTarget + (pos.turn == WHITE_SIDE ? Dir::S : Dir::N);
                 pos.state.capturedPiece = pos.pieces[capturedPawn];
+                dirty.remove(new_ColoredType(PAWN, pos.turn), mov.src);
+                dirty.add(new_ColoredType(PAWN, pos.turn), mov.dst);
+                dirty.remove(pos.state.capturedPiece, capturedPawn);
+
                 pos.clear(capturedPawn);
                 pos.clear(mov.src);
                 pos.set(mov.dst, PAWN, pos.turn);
@@ -135,6 +153,11 @@ namespace sc {
             }
             case PROMOTION:
                 pos.state.capturedPiece = pos.pieces[mov.dst];
+                dirty.remove(new_ColoredType(PAWN, pos.turn), mov.src);
+                dirty.add(new_ColoredType(static_cast<Type>((int) mov.promote + 2), pos.turn), mov.dst);
+                if (pos.state.capturedPiece != NULL_COLORED_TYPE)
+                    dirty.remove(pos.state.capturedPiece, mov.dst);
+
                 pos.clear(mov.dst);
                 pos.clear(mov.src);
                 pos.set(mov.dst, static_cast<Type>((int) mov.promote + 2), pos.turn);
@@ -148,31 +171,15 @@ namespace sc {
 
         pos.turn = opposite_side(pos.turn);
         pos.state.hash ^= zob_IsWhiteTurn; // no need to reset because it is stored in state!
-        pos.isInCheck = false;
+
+        // the hash is final here. the child's probe is the first thing the search does after we return,
+        // so start fetching its bucket while the call into the child runs.
+        if (prefetchTT)
+            tt.prefetch(pos.state.hash);
+        update_check_info(pos);
 
         pos.state.prev = ret;
         pos.state.prevMove = mov;
-
-        // advance by two each time because we can't match something on the turn of the opponent
-        StateInfo *it = ret->prev;
-        
-        // we expect halfmoves to decrease on each step we take back.
-        // if it doesn't, then state was irreversibly changed
-        // so no repetition was possible before that point.
-        auto halfmoves = pos.state.halfmoves;
-
-        while (it != nullptr) {
-            if (it->hash == pos.state.hash) {
-                pos.state.reps = it->reps + 1;
-                break;
-            }
-
-            if (halfmoves <= it->halfmoves)
-                break; // no repetition possible
-
-            halfmoves = it->halfmoves;
-            it = it->prev ? it->prev->prev : nullptr;
-        }
     }
 
     void unmake_move(Position &pos, const Move mov) {
@@ -213,10 +220,41 @@ namespace sc {
                 UNDEFINED();
         }
 
-        pos.isInCheck = false;
-
 //        StateInfo *toDelete = pos.state;
         pos.state = *pos.state.prev; // resets the hash too!
 //        delete toDelete;
     }
+
+    void make_null_move(Position &pos, StateInfo *ret, const bool prefetchTT) {
+        *ret = pos.state;
+
+        if (pos.turn == BLACK_SIDE) pos.fullmoves++;
+        pos.state.halfmoves++;
+
+        if (pos.state.enPassantTarget != NULL_SQUARE)
+            pos.state.hash ^= zob_EnPassantFile[file_ind_of(pos.state.enPassantTarget)];
+        pos.state.enPassantTarget = NULL_SQUARE;
+        pos.state.capturedPiece = NULL_COLORED_TYPE;
+        pos.state.dirty = DirtyPieces{};
+
+        pos.turn = opposite_side(pos.turn);
+        pos.state.hash ^= zob_IsWhiteTurn;
+        if (prefetchTT)
+            tt.prefetch(pos.state.hash);
+
+        // the pieces haven't moved, so neither have the blockers and pinners. nobody can be in check after a
+        // null move, since it's not allowed in check
+        pos.state.checkers = 0;
+        pos.state.attackedValid = false;
+
+        pos.state.prev = ret;
+        pos.state.prevMove = Move{};
+    }
+
+    void unmake_null_move(Position &pos) {
+        pos.turn = opposite_side(pos.turn);
+        if (pos.turn == BLACK_SIDE) pos.fullmoves--;
+
+        pos.state = *pos.state.prev;
+    }
 }
@@ -0,0 +1,149 @@
+#include "scacus/move_picker.hpp"
+#include "scacus/see.hpp"
+
+#include <algorithm>
+
+namespace sc {
+    // a capture is good if it doesn't lose material in the exchange that follows. underpromotions never are.
+    inline static bool is_good_capture(const Position &pos, const Move mov) {
+        if (mov.typeFlags == PROMOTION)
+            return mov.promote == PROMOTE_QUEEN;
+        return see_ge(pos, mov);
+    }
+
+    MovePicker::MovePicker(Position &p, MoveList &ls, const Move tt, const Move *killers, const Move counterMove,
+                           const ButterflyHistory &hist)
+            : pos(p), moves(ls), ttMove(tt), refutations{killers[0], killers[1], counterMove}, history(&hist),
+              quiesc(false) {
+        moves.clear();
+        // the countermove is often one of the killers too
+        if (counterMove == killers[0] || counterMove == killers[1])
+            refutations[2] = Move{};
+    }
+
+    MovePicker::MovePicker(Position &p, MoveList &ls, const Move tt) : pos(p), moves(ls), ttMove(tt), quiesc(true) {
+        moves.clear();
+    }
+
+    void MovePicker::pick_best(Move *end) {
+        Move *best = cur;
+        for (Move *m = cur + 1; m != end; m++)
+            if (moves.score(m) > moves.score(best))
+                best = m;
+
+        std::swap(*cur, *best);
+        std::swap(moves.score(cur), moves.score(best));
+    }
+
+    void MovePicker::sort_descending(Move *begin, Move *end) {
+        for (Move *m = begin + 1; m < end; m++) {
+            const Move mov = *m;
+            const int16_t score = moves.score(m);
+
+            Move *it = m;
+            for (; it != begin && moves.score(it - 1) < score; it--) {
+                *it = *(it - 1);
+                moves.score(it) = moves.score(it - 1);
+            }
+            *it = mov;
+            moves.score(it) = score;
+        }
+    }
+
+    Move MovePicker::next() {
+        switch (stage) {
+            case TT_MOVE:
+                stage = INIT_CAPTURES;
+                if (ttMove != Move{} && (!quiesc || is_noisy(pos, ttMove)) && is_legal(pos, ttMove))
+                    return ttMove;
+                ttMove = Move{};
+                [[fallthrough]];
+
+            case INIT_CAPTURES:
+                generate_legal<GEN_CAPTURES>(moves, pos);
+                inCheck = pos.in_check();
+                cur = endBadCaptures = moves.begin();
+                endCaptures = moves.end();
+
+                // MVV-LVA. the attacker only breaks ties between equal victims
+                for (Move *m = cur; m != endCaptures; m++)
+                    moves.score(m) = static_cast<int16_t>(8 * capture_value(pos, *m)
+                                                          - SEE_VALUE[type_of(pos.piece_at(m->src))] / 100);
+
+                stage = GOOD_CAPTURES;
+                [[fallthrough]];
+
+            case GOOD_CAPTURES:
+                while (cur != endCaptures) {
+                    pick_best(endCaptures);
+                    const Move mov = *cur++;
+                    if (mov == ttMove)
+                        continue;
+
+                    // evasions all have to be looked at. otherwise, the main search leaves the bad
+                    // captures for last, and the quiescence search doesn't bother with them at all
+                    if (inCheck || is_good_capture(pos, mov))
+                        return mov;
+                    if (!quiesc)
+                        *endBadCaptures++ = mov; // over a move that was handed out already
+                }
+
+                // every evasion already came with the captures
+                if (quiesc || inCheck) {
+                    stage = DONE;
+                    return Move{};
+                }
+
+                stage = REFUTATIONS;
+                [[fallthrough]];
+
+            case REFUTATIONS:
+                while (refutationIndex < 3) {
+                    Move &refutation = refutations[refutationIndex++];
+                    if (refutation != ttMove && !is_noisy(pos, refutation) && is_legal(pos, refutation))
+                        return refutation;
+                    refutation = Move{}; // wasn't tried, so the quiets stage mustn't skip it
+                }
+
+                stage = INIT_QUIETS;
+                [[fallthrough]];
+
+            case INIT_QUIETS:
+                // appended after the captures, so that the bad ones stay around
+                generate_legal<GEN_QUIETS>(moves, pos);
+                cur = endCaptures;
+                for (Move *m = cur; m != moves.end(); m++)
+                    moves.score(m) = static_cast<int16_t>(history->get(pos.get_turn(), *m));
+
+                // most of these get searched at nodes where nothing causes a cutoff, so sort them all at once
+                sort_descending(cur, moves.end());
+
+                stage = QUIETS;
+                [[fallthrough]];
+
+            case QUIETS:
+                while (cur != moves.end()) {
+                    const Move mov = *cur++;
+                    if (!already_tried(mov))
+                        return mov;
+                }
+
+                cur = moves.begin();
+                stage = BAD_CAPTURES;
+                [[fallthrough]];
+
+            case BAD_CAPTURES:
+                // already in order, and the TT move was left out
+                if (cur != endBadCaptures)
+                    return *cur++;
+
+                stage = DONE;
+                [[fallthrough]];
+
+            case DONE:
+                return Move{};
+        }
+
+        UNDEFINED();
+    }
+}
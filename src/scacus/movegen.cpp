@@ -26,6 +26,9 @@ namespace sc {
     Magic ROOK_MAGICS[BOARD_SIZE];
     Magic BISHOP_MAGICS[BOARD_SIZE];
 
+    uint64_t CUCKOO_KEYS[CUCKOO_SIZE];
+    Move CUCKOO_MOVES[CUCKOO_SIZE];
+
     // checks if moving in `direction` from square `s` would take you off of the board
     // by seeing if the file number jumps by more than 2
     static bool does_wrap(Square s, int direction) {
@@ -43,12 +46,58 @@ namespace sc {
         for (int i = 0; i < BOARD_SIZE; i++)
             for (int j = 0; j < NUM_COLORED_PIECE_TYPES; j++)
                 zob_Pieces[i][j] = rand_u64(seed);
+
+        // Position::clear() hashes out whatever was on the square, empty or not. an empty square has to
+        // hash to nothing, or the hash of a position depends on the moves that led to it
+        for (int i = 0; i < BOARD_SIZE; i++)
+            zob_Pieces[i][NULL_COLORED_TYPE] = 0;
+    }
+
+    // where a piece of type t on sq could go on an empty board. needs the magics
+    static Bitboard empty_board_moves(const Type t, const Square sq) {
+        switch (t) {
+            case KING: return king_moves(sq);
+            case KNIGHT: return knight_moves(sq);
+            case BISHOP: return pseudo_attacks<BISHOP_MAGICS>(sq);
+            case ROOK: return pseudo_attacks<ROOK_MAGICS>(sq);
+            case QUEEN: return pseudo_attacks<BISHOP_MAGICS>(sq) | pseudo_attacks<ROOK_MAGICS>(sq);
+            default: return 0;
+        }
+    }
+
+    // every move of a piece other than a pawn, in one direction only: the hash difference is the same both ways.
+    // a move gets pushed into its first slot, and whatever was there moves on to its other one, and so on
+    // until something lands in an empty slot. see https://www.chessprogramming.org/Cuckoo_Hashing
+    static void init_cuckoo() {
+        for (Side side : {BLACK_SIDE, WHITE_SIDE}) {
+            for (Type t : {KING, QUEEN, ROOK, BISHOP, KNIGHT}) {
+                const ColoredType piece = new_ColoredType(t, side);
+                for (Square s1 = 0; s1 < BOARD_SIZE; s1++) {
+                    for (Square s2 = s1 + 1; s2 < BOARD_SIZE; s2++) {
+                        if (!(empty_board_moves(t, s1) & to_bitboard(s2)))
+                            continue;
+
+                        Move mov = new_move_normal(s1, s2);
+                        uint64_t key = zob_Pieces[s1][piece] ^ zob_Pieces[s2][piece] ^ zob_IsWhiteTurn;
+                        int slot = cuckoo_h1(key);
+                        while (true) {
+                            std::swap(CUCKOO_KEYS[slot], key);
+                            std::swap(CUCKOO_MOVES[slot], mov);
+                            if (mov == Move{})
+                                break;
+                            slot = slot == cuckoo_h1(key) ? cuckoo_h2(key) : cuckoo_h1(key);
+                        }
+                    }
+                }
+            }
+        }
     }
 
     // this code doesn't have to be efficient as it's only run once at startup
     // so i've gone and done everything the lazy way!
     void init_movegen() {
         init_zobrist();
+        init_psqt();
 
         for (Square sq = 0; sq < BOARD_SIZE; sq++) {
             int rank = rank_ind_of(sq);
@@ -117,6 +166,8 @@ namespace sc {
             init_magics<BISHOP_MAGICS>(sq);
             init_magics<ROOK_MAGICS>(sq);
         }
+
+        init_cuckoo();
     }
 
 }
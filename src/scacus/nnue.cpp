@@ -0,0 +1,178 @@
+#include "scacus/nnue.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+#include <immintrin.h>
+
+namespace sc::nnue {
+    static Network net;
+    static bool loaded = false;
+
+    // the order of the pieces in the inputs, indexed by Type
+    constexpr int PIECE_INDEX[NUM_UNCOLORED_PIECE_TYPES] = {0, 5, 4, 3, 2, 1, 0};
+
+    // whether `side` sees the board mirrored, i.e. has its king on the kingside
+    inline static bool is_mirrored(const Square kingSq) {
+        return file_ind_of(kingSq) >= 4;
+    }
+
+    inline static int feature(const Side side, const bool mirrored, const ColoredType piece, const Square sq) {
+        const Square rel = (side == WHITE_SIDE ? sq : sq ^ 56) ^ (mirrored ? 7 : 0);
+        return (side_of(piece) == side ? 0 : 384) + PIECE_INDEX[type_of(piece)] * 64 + rel;
+    }
+
+    // the compiler vectorizes these just fine on its own
+    inline static void add_feature(int16_t *values, const int index) {
+        for (int i = 0; i < HIDDEN; i++)
+            values[i] += net.featureWeights[index][i];
+    }
+
+    inline static void sub_feature(int16_t *values, const int index) {
+        for (int i = 0; i < HIDDEN; i++)
+            values[i] -= net.featureWeights[index][i];
+    }
+
+    bool load_network(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return false;
+
+        // read into a copy first, so that a truncated file doesn't leave half a network behind
+        auto tmp = std::make_unique<Network>();
+        in.read(reinterpret_cast<char *>(tmp->featureWeights), sizeof(tmp->featureWeights));
+        in.read(reinterpret_cast<char *>(tmp->featureBias), sizeof(tmp->featureBias));
+        in.read(reinterpret_cast<char *>(tmp->outputWeights), sizeof(tmp->outputWeights));
+        in.read(reinterpret_cast<char *>(&tmp->outputBias), sizeof(tmp->outputBias));
+
+        // anything left over means it's a different architecture
+        if (!in || in.peek() != std::ifstream::traits_type::eof())
+            return false;
+
+        net = *tmp;
+        loaded = true;
+        return true;
+    }
+
+    bool has_network() {
+        return loaded;
+    }
+
+    void RefreshCache::clear() {
+        for (auto &sideEntries : entries) {
+            for (Entry &e : sideEntries) {
+                std::memcpy(e.values, net.featureBias, sizeof(e.values));
+                std::memset(e.byColor, 0, sizeof(e.byColor));
+                std::memset(e.byType, 0, sizeof(e.byType));
+            }
+        }
+    }
+
+    void RefreshCache::refresh(const Position &pos, const Side side, Accumulator &acc) {
+        const bool mirrored = is_mirrored(get_lsb(pos.by_side(side) & pos.by_type(KING)));
+        Entry &e = entries[side][mirrored];
+
+        for (Side c : {BLACK_SIDE, WHITE_SIDE}) {
+            for (int t = KING; t < NUM_UNCOLORED_PIECE_TYPES; t++) {
+                const ColoredType piece = new_ColoredType(static_cast<Type>(t), c);
+                const Bitboard now = pos.by_side(c) & pos.by_type(static_cast<Type>(t));
+                const Bitboard was = e.byColor[c] & e.byType[t];
+
+                for (Bitboard added = now & ~was; added;)
+                    add_feature(e.values, feature(side, mirrored, piece, pop_lsb(added)));
+                for (Bitboard removed = was & ~now; removed;)
+                    sub_feature(e.values, feature(side, mirrored, piece, pop_lsb(removed)));
+            }
+        }
+
+        for (Side c : {BLACK_SIDE, WHITE_SIDE})
+            e.byColor[c] = pos.by_side(c);
+        for (int t = 0; t < NUM_UNCOLORED_PIECE_TYPES; t++)
+            e.byType[t] = pos.by_type(static_cast<Type>(t));
+
+        std::memcpy(acc.values[side], e.values, sizeof(e.values));
+        acc.computed[side] = true;
+    }
+
+    // whether the move leading to `st` changed how `side` sees the board
+    inline static bool king_crossed(const StateInfo &st, const Side side) {
+        const DirtyPieces &d = st.dirty;
+        const ColoredType king = new_ColoredType(KING, side);
+        // the king is always the first piece a king move or castle adds and removes
+        return d.numAdded && d.added[0] == king && is_mirrored(d.addedSq[0]) != is_mirrored(d.removedSq[0]);
+    }
+
+    void update(const Position &pos, Accumulator *acc, const int ply, RefreshCache &cache) {
+        for (Side side : {BLACK_SIDE, WHITE_SIDE}) {
+            if (acc[ply].computed[side])
+                continue;
+
+            // look for the closest position before this one with its accumulator computed. past a king
+            // crossing over, the features are different ones, and the refresh cache has to do
+            int from = ply;
+            const StateInfo *st = &pos.get_state();
+            while (from > 0 && !acc[from].computed[side] && !king_crossed(*st, side)) {
+                st = st->prev;
+                from--;
+            }
+
+            if (!acc[from].computed[side]) {
+                cache.refresh(pos, side, acc[ply]);
+                continue;
+            }
+
+            // the moves in between only turn inputs on and off, in whatever order
+            const bool mirrored = is_mirrored(get_lsb(pos.by_side(side) & pos.by_type(KING)));
+            int16_t *values = acc[ply].values[side];
+            std::memcpy(values, acc[from].values[side], sizeof(acc[ply].values[side]));
+
+            st = &pos.get_state();
+            for (int i = ply; i > from; i--, st = st->prev) {
+                const DirtyPieces &d = st->dirty;
+                for (int j = 0; j < d.numAdded; j++)
+                    add_feature(values, feature(side, mirrored, d.added[j], d.addedSq[j]));
+                for (int j = 0; j < d.numRemoved; j++)
+                    sub_feature(values, feature(side, mirrored, d.removed[j], d.removedSq[j]));
+            }
+            acc[ply].computed[side] = true;
+        }
+    }
+
+    int evaluate(const Accumulator &acc, const Side turn) {
+        const int16_t *us = acc.values[turn];
+        const int16_t *them = acc.values[opposite_side(turn)];
+
+#if defined(__AVX2__)
+        // clipped ReLU, then 16 multiplications at a time, summed in pairs into 8 int32 lanes
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i qa = _mm256_set1_epi16(QA);
+        __m256i sum = _mm256_setzero_si256();
+
+        for (int half = 0; half < 2; half++) {
+            const int16_t *values = half == 0 ? us : them;
+            const int16_t *weights = net.outputWeights + half * HIDDEN;
+            for (int i = 0; i < HIDDEN; i += 16) {
+                __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i *>(values + i));
+                v = _mm256_min_epi16(_mm256_max_epi16(v, zero), qa);
+                const __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i *>(weights + i));
+                sum = _mm256_add_epi32(sum, _mm256_madd_epi16(v, w));
+            }
+        }
+
+        __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_SHUFFLE(2, 3, 0, 1)));
+        const int64_t output = _mm_cvtsi128_si32(sum128);
+#else
+        int64_t output = 0;
+        for (int i = 0; i < HIDDEN; i++) {
+            output += std::clamp<int>(us[i], 0, QA) * net.outputWeights[i];
+            output += std::clamp<int>(them[i], 0, QA) * net.outputWeights[HIDDEN + i];
+        }
+#endif
+
+        return static_cast<int>((output + net.outputBias) * SCALE / (QA * QB));
+    }
+}
@@ -0,0 +1,142 @@
+#include "scacus/pawns.hpp"
+
+#include <array>
+
+namespace {
+    using namespace sc;
+
+    // indexed by relative rank, i.e. counting from the side's own back rank
+    constexpr int PASSED_MG[8] = {0, 5, 10, 15, 30, 50, 80, 0};
+    constexpr int PASSED_EG[8] = {0, 10, 20, 35, 60, 100, 150, 0};
+
+    constexpr int ISOLATED_MG = -10, ISOLATED_EG = -15;
+    constexpr int DOUBLED_MG = -10, DOUBLED_EG = -25; // for each pawn with another one of ours in front
+    constexpr int BACKWARD_MG = -8, BACKWARD_EG = -10;
+
+    // for each pawn right in front of the king, on its file or the ones next to it, and one rank further
+    constexpr int SHIELD_NEAR = 15, SHIELD_FAR = 8;
+
+    inline constexpr int relative_rank(const Side side, const Square sq) {
+        return side == WHITE_SIDE ? rank_ind_of(sq) : 7 - rank_ind_of(sq);
+    }
+
+    struct Masks {
+        Bitboard adjacentFiles[8];
+        Bitboard forwardFile[NUM_SIDES][BOARD_SIZE];  // the squares in front of a pawn
+        Bitboard passed[NUM_SIDES][BOARD_SIZE];       // ...and on the files next to it
+        Bitboard support[NUM_SIDES][BOARD_SIZE];      // the files next to it, its own rank and behind
+        Bitboard shieldNear[NUM_SIDES][BOARD_SIZE];   // a king's file and the ones next to it, one rank up
+        Bitboard shieldFar[NUM_SIDES][BOARD_SIZE];    // ...two ranks up
+    };
+
+    static const auto MASKS = []() {
+        Masks m{};
+        for (int file = 0; file < 8; file++) {
+            if (file > 0) m.adjacentFiles[file] |= file_bb('a' + file - 1);
+            if (file < 7) m.adjacentFiles[file] |= file_bb('a' + file + 1);
+        }
+
+        for (Square sq = 0; sq < BOARD_SIZE; sq++) {
+            const int file = file_ind_of(sq);
+            const Bitboard threeFiles = m.adjacentFiles[file] | file_bb('a' + file);
+
+            for (Side side : {BLACK_SIDE, WHITE_SIDE}) {
+                for (Square other = 0; other < BOARD_SIZE; other++) {
+                    const int ahead = relative_rank(side, other) - relative_rank(side, sq);
+                    const Bitboard bb = to_bitboard(other);
+
+                    if (ahead > 0 && (file_bb('a' + file) & bb)) m.forwardFile[side][sq] |= bb;
+                    if (ahead > 0 && (threeFiles & bb)) m.passed[side][sq] |= bb;
+                    if (ahead <= 0 && (m.adjacentFiles[file] & bb)) m.support[side][sq] |= bb;
+                    if (ahead == 1 && (threeFiles & bb)) m.shieldNear[side][sq] |= bb;
+                    if (ahead == 2 && (threeFiles & bb)) m.shieldFar[side][sq] |= bb;
+                }
+            }
+        }
+        return m;
+    }();
+
+    inline Bitboard pawn_attacks(const Side side, const Bitboard pawns) {
+        const Bitboard notA = ~file_bb('a'), notH = ~file_bb('h');
+        return side == WHITE_SIDE ? ((pawns & notA) << 7) | ((pawns & notH) << 9)
+                                  : ((pawns & notA) >> 9) | ((pawns & notH) >> 7);
+    }
+
+    void evaluate_pawns(const Position &pos, PawnEntry &e) {
+        const Bitboard pawns = pos.by_type(PAWN);
+        int mg = 0, eg = 0;
+
+        for (Side side : {BLACK_SIDE, WHITE_SIDE})
+            e.attacks[side] = pawn_attacks(side, pawns & pos.by_side(side));
+
+        for (Side side : {BLACK_SIDE, WHITE_SIDE}) {
+            const Bitboard ours = pawns & pos.by_side(side);
+            const Bitboard theirs = pawns & pos.by_side(opposite_side(side));
+            const int sign = side == WHITE_SIDE ? 1 : -1;
+            e.passed[side] = 0;
+
+            for (Bitboard it = ours; it;) {
+                const Square sq = pop_lsb(it);
+                const Square stop = side == WHITE_SIDE ? sq + Dir::N : sq + Dir::S;
+                int pawnMg = 0, pawnEg = 0;
+
+                // the frontmost of doubled pawns can still be passed, the ones behind it can't
+                const bool doubled = MASKS.forwardFile[side][sq] & ours;
+                if (doubled) {
+                    pawnMg += DOUBLED_MG;
+                    pawnEg += DOUBLED_EG;
+                } else if (!(MASKS.passed[side][sq] & theirs)) {
+                    e.passed[side] |= to_bitboard(sq);
+                    pawnMg += PASSED_MG[relative_rank(side, sq)];
+                    pawnEg += PASSED_EG[relative_rank(side, sq)];
+                }
+
+                // isolated: no pawns of ours on the files next to it. backward: none that are level or behind,
+                // so none can come up to protect it, and it can't advance without being taken
+                if (!(MASKS.adjacentFiles[file_ind_of(sq)] & ours)) {
+                    pawnMg += ISOLATED_MG;
+                    pawnEg += ISOLATED_EG;
+                } else if (!(MASKS.support[side][sq] & ours) && (to_bitboard(stop) & e.attacks[opposite_side(side)])) {
+                    pawnMg += BACKWARD_MG;
+                    pawnEg += BACKWARD_EG;
+                }
+
+                mg += sign * pawnMg;
+                eg += sign * pawnEg;
+            }
+
+            e.kingSq[side] = NULL_SQUARE;
+        }
+
+        e.mg = static_cast<int16_t>(mg);
+        e.eg = static_cast<int16_t>(eg);
+    }
+}
+
+namespace sc {
+    int PawnEntry::shield_score(const Position &pos, const Side side) {
+        const Square king = get_lsb(pos.by_side(side) & pos.by_type(KING));
+        if (kingSq[side] != king) {
+            const Bitboard ours = pos.by_type(PAWN) & pos.by_side(side);
+            kingSq[side] = king;
+            shield[side] = static_cast<int16_t>(SHIELD_NEAR * popcnt(ours & MASKS.shieldNear[side][king])
+                                                + SHIELD_FAR * popcnt(ours & MASKS.shieldFar[side][king]));
+        }
+        return shield[side];
+    }
+
+    PawnEntry &PawnTable::probe(const Position &pos) {
+        const uint64_t key = pos.get_state().pawnHash;
+        PawnEntry &e = entries[key & (ENTRIES - 1)];
+
+        probes++;
+        if (e.key == key) {
+            hits++;
+            return e;
+        }
+
+        e.key = key;
+        evaluate_pawns(pos, e);
+        return e;
+    }
+}
@@ -0,0 +1,323 @@
+#include "scacus/perft.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+    using namespace sc;
+
+    // a subtree: the moves leading to it from the root, and how many plies to count below it
+    struct PerftTask {
+        static constexpr int MAX_PATH = 16;
+
+        Move path[MAX_PATH];
+        int length;
+        int depth;
+        int rootIndex; // which root move path[0] is, for the divide output
+    };
+
+    // subtrees any deeper get split up into one per move, so that there is always something left to steal.
+    // the ones at this depth take around a millisecond
+    constexpr int SPLIT_DEPTH = 4;
+
+    // with a table, subtrees aren't split any further than this many plies from the root. the table only
+    // knows about what is counted within a task, and most of what it saves is high up in the tree.
+    // the replies to the root moves still make several hundred tasks
+    constexpr int HASHED_SPLIT_PLIES = 2;
+
+    // Leaf counts of subtrees by StateInfo::hash and depth, shared by all the threads of a perft run.
+    // Lockless like the transposition table: an entry is the count and depth packed into one word, and that
+    // word XOR'd with the whole hash in the other. A probe only hits if both give back exactly the hash and
+    // depth it's looking for, which an entry torn by two threads writing at once won't, so counts stay exact.
+    class PerftTable {
+    private:
+        static constexpr int BUCKET_ENTRIES = 4;
+
+        struct Entry {
+            std::atomic<uint64_t> check; // hash ^ data
+            std::atomic<uint64_t> data;  // count:56 depth:8
+        };
+
+        struct alignas(64) Bucket {
+            Entry entries[BUCKET_ENTRIES];
+        };
+        static_assert(sizeof(Bucket) == 64);
+
+        std::unique_ptr<Bucket[]> table;
+        size_t numBuckets;
+
+        [[nodiscard]] inline Bucket &bucket(const uint64_t hash) const {
+            return table[hash & (numBuckets - 1)];
+        }
+
+    public:
+        // the biggest power of two number of buckets that fits in mb megabytes
+        explicit PerftTable(const size_t mb) {
+            numBuckets = 1;
+            while (numBuckets * 2 * sizeof(Bucket) <= mb * 1024 * 1024)
+                numBuckets *= 2;
+            table = std::make_unique<Bucket[]>(numBuckets);
+        }
+
+        inline bool probe(const uint64_t hash, const int depth, uint64_t &count) const {
+            for (const Entry &e : bucket(hash).entries) {
+                const uint64_t data = e.data.load(std::memory_order_relaxed);
+                if ((data & 0xFF) == static_cast<uint64_t>(depth)
+                    && (e.check.load(std::memory_order_relaxed) ^ data) == hash) {
+                    count = data >> 8;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // the shallowest entry goes: it took the least work to count
+        inline void store(const uint64_t hash, const int depth, const uint64_t count) {
+            Entry *replace = nullptr;
+            int replaceDepth = 256;
+            for (Entry &e : bucket(hash).entries) {
+                const int entryDepth = static_cast<int>(e.data.load(std::memory_order_relaxed) & 0xFF);
+                if (entryDepth < replaceDepth) {
+                    replace = &e;
+                    replaceDepth = entryDepth;
+                }
+            }
+
+            const uint64_t data = count << 8 | static_cast<uint64_t>(depth);
+            replace->data.store(data, std::memory_order_relaxed);
+            replace->check.store(hash ^ data, std::memory_order_relaxed);
+        }
+    };
+
+    // like perft2, but looking up subtrees of depth 2 and more in the table first
+    uint64_t perft_hashed(Position &pos, const int depth, PerftTable &table) {
+        if (depth == 1)
+            return count_legal_moves(pos);
+
+        uint64_t count = 0;
+        const uint64_t hash = pos.get_state().hash;
+        if (table.probe(hash, depth, count))
+            return count;
+
+        MoveList ls;
+        legal_moves_from<false>(ls, pos);
+        for (const Move mov : ls) {
+            StateInfo undo;
+            make_move(pos, mov, &undo);
+            count += perft_hashed(pos, depth - 1, table);
+            unmake_move(pos, mov);
+        }
+
+        table.store(hash, depth, count);
+        return count;
+    }
+
+    // perft2<false> only stops at depth 2
+    inline uint64_t count_leaves(Position &pos, const int depth, PerftTable *table) {
+        if (depth == 0)
+            return 1;
+        if (depth == 1)
+            return count_legal_moves(pos);
+        return table ? perft_hashed(pos, depth, *table) : perft2<false>(pos, depth);
+    }
+
+    class PerftPool {
+    private:
+        struct alignas(64) Worker {
+            std::mutex mtx;
+            std::deque<PerftTask> tasks;
+            uint64_t nodes = 0;
+            uint64_t steals = 0;
+        };
+
+        const Position &root;
+        PerftTable *table;
+        const unsigned numWorkers;
+        std::unique_ptr<Worker[]> workers;
+        std::unique_ptr<std::atomic<uint64_t>[]> rootCounts;
+        std::atomic<uint64_t> pending{0}; // tasks that are queued or being worked on
+
+        bool pop(const unsigned id, PerftTask &task) {
+            Worker &me = workers[id];
+            std::lock_guard<std::mutex> lg(me.mtx);
+            if (me.tasks.empty())
+                return false;
+            task = me.tasks.back();
+            me.tasks.pop_back();
+            return true;
+        }
+
+        bool steal(const unsigned id, PerftTask &task) {
+            for (unsigned i = 1; i < numWorkers; i++) {
+                Worker &victim = workers[(id + i) % numWorkers];
+                std::lock_guard<std::mutex> lg(victim.mtx);
+                if (victim.tasks.empty())
+                    continue;
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                workers[id].steals++;
+                return true;
+            }
+            return false;
+        }
+
+        void run_task(Position &pos, const unsigned id, const PerftTask &task) {
+            StateInfo states[PerftTask::MAX_PATH];
+            for (int i = 0; i < task.length; i++)
+                make_move(pos, task.path[i], &states[i]);
+
+            const int maxPath = table ? HASHED_SPLIT_PLIES : PerftTask::MAX_PATH;
+            if (task.depth > SPLIT_DEPTH && task.length < maxPath) {
+                MoveList ls;
+                legal_moves_from<false>(ls, pos);
+
+                // before this task counts as done, or the others might think everything is
+                pending.fetch_add(ls.size(), std::memory_order_relaxed);
+                std::lock_guard<std::mutex> lg(workers[id].mtx);
+                for (const Move mov : ls) {
+                    PerftTask child = task;
+                    child.path[child.length++] = mov;
+                    child.depth--;
+                    workers[id].tasks.push_back(child);
+                }
+            } else {
+                const uint64_t n = count_leaves(pos, task.depth, table);
+                workers[id].nodes += n;
+                rootCounts[task.rootIndex].fetch_add(n, std::memory_order_relaxed);
+            }
+
+            for (int i = task.length - 1; i >= 0; i--)
+                unmake_move(pos, task.path[i]);
+        }
+
+        void work(const unsigned id) {
+            Position pos = root;
+            PerftTask task;
+            while (pending.load(std::memory_order_acquire) != 0) {
+                if (!pop(id, task) && !steal(id, task)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                run_task(pos, id, task);
+                pending.fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+    public:
+        // table: where to look up and store the counts of subtrees, if anywhere
+        PerftPool(const Position &pos, PerftTable *tbl, const unsigned threads)
+            : root(pos), table(tbl), numWorkers(threads), workers(std::make_unique<Worker[]>(threads)) {}
+
+        // returns the count below each of rootMoves, all of them depth - 1 deep
+        std::vector<uint64_t> run(const MoveList &rootMoves, const int depth) {
+            rootCounts = std::make_unique<std::atomic<uint64_t>[]>(rootMoves.size());
+            for (size_t i = 0; i < rootMoves.size(); i++) {
+                rootCounts[i] = 0;
+                workers[0].tasks.push_back(PerftTask{{rootMoves.at(i)}, 1, depth - 1, static_cast<int>(i)});
+            }
+            pending = rootMoves.size();
+
+            std::vector<std::thread> threads;
+            for (unsigned i = 0; i < numWorkers; i++)
+                threads.emplace_back(&PerftPool::work, this, i);
+            for (auto &t : threads)
+                t.join();
+
+            std::vector<uint64_t> counts(rootMoves.size());
+            for (size_t i = 0; i < rootMoves.size(); i++)
+                counts[i] = rootCounts[i];
+            return counts;
+        }
+
+        [[nodiscard]] uint64_t get_nodes(const unsigned id) const {
+            return workers[id].nodes;
+        }
+
+        [[nodiscard]] uint64_t get_steals(const unsigned id) const {
+            return workers[id].steals;
+        }
+    };
+}
+
+namespace sc {
+    template <bool ROOT>
+    uint64_t perft2(Position &pos, int depth) {
+        sc::MoveList legals = legal_moves_from<false>(pos);
+        uint64_t ret = 0, res = 0;
+        const bool leaf_coneybear = (depth == 2);
+
+        for (const auto &m : legals) {
+            StateInfo undo;
+            if (!ROOT || depth > 1) {
+                sc::make_move(pos, m, &undo);
+                if (leaf_coneybear)
+                    ret += (res = count_legal_moves(pos)); // bulk counting: the leaves are never created
+                else
+                    ret += (res = perft2<false>(pos, depth - 1));
+                sc::unmake_move(pos, m);
+            } else {
+                res = 1;
+                ret++;
+            }
+
+            if constexpr (ROOT)
+                std::cout << m.long_alg_notation() << ": " << res << '\n';
+        }
+
+        return ret;
+    }
+    template uint64_t perft2<true>(Position &, int);
+    template uint64_t perft2<false>(Position &, int);
+
+    void run_perft(Position &pos, int depth) {
+        auto start = std::chrono::high_resolution_clock::now();
+        uint64_t res = perft2<true>(pos, depth);
+        auto diff = std::chrono::high_resolution_clock::now() - start;
+        auto nps = (double) res / ((double) std::chrono::duration_cast<std::chrono::microseconds>(diff).count() / 1000000.0);
+
+        std::cout << "Nodes searched (depth=" << depth << "): " << res;
+        std::cout << " (" << nps / 1000000.0 << " mnps)" << std::endl;
+    }
+
+    void run_perft(Position &pos, int depth, unsigned threads, size_t hashMb) {
+        if (depth < 1 || threads < 1) {
+            run_perft(pos, depth);
+            return;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        MoveList rootMoves;
+        legal_moves_from<false>(rootMoves, pos);
+
+        std::unique_ptr<PerftTable> table;
+        if (hashMb)
+            table = std::make_unique<PerftTable>(hashMb);
+
+        PerftPool pool(pos, table.get(), threads);
+        const std::vector<uint64_t> counts = pool.run(rootMoves, depth);
+        auto diff = std::chrono::high_resolution_clock::now() - start;
+        const double seconds = (double) std::chrono::duration_cast<std::chrono::microseconds>(diff).count() / 1000000.0;
+
+        uint64_t res = 0;
+        for (size_t i = 0; i < rootMoves.size(); i++) {
+            std::cout << rootMoves.at(i).long_alg_notation() << ": " << counts[i] << '\n';
+            res += counts[i];
+        }
+
+        std::cout << "Nodes searched (depth=" << depth << "): " << res;
+        std::cout << " (" << (double) res / seconds / 1000000.0 << " mnps)" << '\n';
+        for (unsigned i = 0; i < threads; i++) {
+            std::cout << "info string thread " << i << " nodes " << pool.get_nodes(i)
+                      << " mnps " << (double) pool.get_nodes(i) / seconds / 1000000.0
+                      << " steals " << pool.get_steals(i) << '\n';
+        }
+        std::cout << std::flush;
+    }
+}
@@ -0,0 +1,82 @@
+#include "scacus/see.hpp"
+
+namespace sc {
+    // the swap algorithm as done by Stockfish: instead of building the whole list of gains, keep only
+    // the balance relative to the threshold, and stop as soon as one side can't be made to lose by stopping
+    bool see_ge(const Position &pos, const Move mov, const int threshold) {
+        if (mov.typeFlags != NORMAL)
+            return threshold <= 0;
+
+        // what we win if nobody recaptures
+        int swap = SEE_VALUE[type_of(pos.piece_at(mov.dst))] - threshold;
+        if (swap < 0)
+            return false;
+
+        // what we still have if our piece gets taken for nothing
+        swap = SEE_VALUE[type_of(pos.piece_at(mov.src))] - swap;
+        if (swap <= 0)
+            return true;
+
+        const Bitboard diagonals = pos.by_type(BISHOP) | pos.by_type(QUEEN);
+        const Bitboard orthogonals = pos.by_type(ROOK) | pos.by_type(QUEEN);
+
+        Bitboard occ = (pos.by_side(WHITE_SIDE) | pos.by_side(BLACK_SIDE)) ^ to_bitboard(mov.src) ^ to_bitboard(mov.dst);
+        Bitboard attackers = attackers_to(pos, mov.dst, occ);
+        Side stm = side_of(pos.piece_at(mov.src));
+        const StateInfo &st = pos.get_state();
+
+        // 1 if the side that made the move is ahead of the threshold, given that it's stm's turn to capture
+        int res = 1;
+
+        while (true) {
+            stm = opposite_side(stm);
+            attackers &= occ; // drop the pieces that were traded off already
+
+            Bitboard stmAttackers = attackers & pos.by_side(stm);
+
+            // pieces pinned to their king can't join in, as long as whatever pins them is still there
+            if (st.pinners[stm] & occ)
+                stmAttackers &= ~st.blockers[stm];
+
+            if (!stmAttackers)
+                break;
+
+            res ^= 1;
+
+            // capture with the least valuable attacker. if stm is still behind after that, it loses the
+            // exchange. taking it off the board may uncover a slider behind it
+            Bitboard bb;
+            if ((bb = stmAttackers & pos.by_type(PAWN))) {
+                if ((swap = SEE_VALUE[PAWN] - swap) < res)
+                    break;
+                occ ^= to_bitboard(get_lsb(bb));
+                attackers |= lookup<BISHOP_MAGICS>(mov.dst, occ) & diagonals;
+            } else if ((bb = stmAttackers & pos.by_type(KNIGHT))) {
+                if ((swap = SEE_VALUE[KNIGHT] - swap) < res)
+                    break;
+                occ ^= to_bitboard(get_lsb(bb));
+            } else if ((bb = stmAttackers & pos.by_type(BISHOP))) {
+                if ((swap = SEE_VALUE[BISHOP] - swap) < res)
+                    break;
+                occ ^= to_bitboard(get_lsb(bb));
+                attackers |= lookup<BISHOP_MAGICS>(mov.dst, occ) & diagonals;
+            } else if ((bb = stmAttackers & pos.by_type(ROOK))) {
+                if ((swap = SEE_VALUE[ROOK] - swap) < res)
+                    break;
+                occ ^= to_bitboard(get_lsb(bb));
+                attackers |= lookup<ROOK_MAGICS>(mov.dst, occ) & orthogonals;
+            } else if ((bb = stmAttackers & pos.by_type(QUEEN))) {
+                if ((swap = SEE_VALUE[QUEEN] - swap) < res)
+                    break;
+                occ ^= to_bitboard(get_lsb(bb));
+                attackers |= (lookup<BISHOP_MAGICS>(mov.dst, occ) & diagonals)
+                             | (lookup<ROOK_MAGICS>(mov.dst, occ) & orthogonals);
+            } else {
+                // only the king is left. it can only capture if the other side has nothing to recapture with
+                return (attackers & ~pos.by_side(stm)) ? res ^ 1 : res;
+            }
+        }
+
+        return res;
+    }
+}
@@ -1,13 +1,31 @@
 #include "scacus/movegen.hpp"
 
+#include <algorithm>
+
 // this is some cryptic macro usage that probably isn't ideal
-#define ACCUM_MOVES(FUN, BB, LAND, LS, POS) {                       \
+// they expect `OUT`, `ls` and `count` to be in scope, see generate_moves()
+
+// emits MOV. in GEN_ANY mode, any legal move is enough to be done
+#define PUSH_MOVE(MOV) {                                            \
+    if constexpr (OUT == GEN_COUNT) count++;                        \
+    else if constexpr (OUT == GEN_ANY) return 1;                    \
+    else ls->push_back(MOV);                                        \
+}
+
+// emits a normal move from SRC to each square of DSTS. counting them is just a popcount
+#define PUSH_MOVES(SRC, DSTS) {                                     \
+    Bitboard _scacus_dsts = DSTS;                                   \
+    if constexpr (OUT == GEN_COUNT) count += popcnt(_scacus_dsts);  \
+    else if constexpr (OUT == GEN_ANY) { if (_scacus_dsts) return 1; } \
+    else while (_scacus_dsts)                                       \
+        ls->push_back(new_move_normal(SRC, pop_lsb(_scacus_dsts))); \
+}
+
+#define ACCUM_MOVES(FUN, BB, LAND) {                                \
     Bitboard _scacus_bb = BB;                                       \
     while (_scacus_bb) {                                            \
         Square SQ = pop_lsb(_scacus_bb);                            \
-        Bitboard _scacus_it = (FUN) & (LAND);                       \
-        while (_scacus_it)                                          \
-            LS.push_back(new_move_normal(SQ, pop_lsb(_scacus_it))); \
+        PUSH_MOVES(SQ, (FUN) & (LAND));                             \
     }                                                               \
 }
 
@@ -51,12 +69,73 @@ namespace sc {
         return pinned;
     }
 
+    // the pieces that are all that stands between side's king and a slider of the other side, and the sliders
+    // that would be giving check if one of side's own pieces weren't in the way
+    static inline void slider_blockers(const Position &pos, const Side side, Bitboard &blockers, Bitboard &pinners) {
+        const Square kingSq = get_lsb(pos.by_side(side) & pos.by_type(KING));
+        const Bitboard occ = pos.by_side(WHITE_SIDE) | pos.by_side(BLACK_SIDE);
+
+        // the sliders that would see the king on an empty board
+        Bitboard snipers = ((pseudo_attacks<BISHOP_MAGICS>(kingSq) & (pos.by_type(BISHOP) | pos.by_type(QUEEN)))
+                            | (pseudo_attacks<ROOK_MAGICS>(kingSq) & (pos.by_type(ROOK) | pos.by_type(QUEEN))))
+                           & pos.by_side(opposite_side(side));
+
+        blockers = pinners = 0;
+        while (snipers) {
+            const Square sq = pop_lsb(snipers);
+            const Bitboard between = pin_line(kingSq, sq) & occ & ~to_bitboard(sq);
+
+            if (between && (between & (between - 1)) == 0) {
+                blockers |= between;
+                if (between & pos.by_side(side))
+                    pinners |= to_bitboard(sq);
+            }
+        }
+    }
+
+    void update_check_info(Position &pos) {
+        StateInfo &st = pos.state;
+
+        st.checkers = checkers(pos);
+        slider_blockers(pos, BLACK_SIDE, st.blockers[BLACK_SIDE], st.pinners[BLACK_SIDE]);
+        slider_blockers(pos, WHITE_SIDE, st.blockers[WHITE_SIDE], st.pinners[WHITE_SIDE]);
+        st.attackedValid = false;
+    }
+
+    // every square the opponent of SIDE attacks. sliders see through SIDE's king, so that the king can't
+    // step back along the line of a check
+    template <Side SIDE>
+    static inline Bitboard attacked_squares(const Position &pos) {
+        const Bitboard opponent = pos.by_side(opposite_side(SIDE));
+        const Bitboard occ = (opponent | pos.by_side(SIDE)) ^ (pos.by_side(SIDE) & pos.by_type(KING));
+
+        Bitboard attk = king_moves(get_lsb(opponent & pos.by_type(KING)));
+
+        Bitboard it = opponent & (pos.by_type(BISHOP) | pos.by_type(QUEEN));
+        while (it) attk |= lookup<BISHOP_MAGICS>(pop_lsb(it), occ);
+
+        it = opponent & (pos.by_type(ROOK) | pos.by_type(QUEEN));
+        while (it) attk |= lookup<ROOK_MAGICS>(pop_lsb(it), occ);
+
+        it = opponent & pos.by_type(KNIGHT);
+        while (it) attk |= knight_moves(pop_lsb(it));
+
+        it = opponent & pos.by_type(PAWN);
+        while (it) attk |= pawn_attacks<opposite_side(SIDE)>(pop_lsb(it));
+
+        return attk;
+    }
+
     // if true, quiescence move generation will include checks.
     constexpr bool INCLUDE_CHECKS = false;
 
-    template <Side SIDE, bool QUIESC>
-    void standard_moves(MoveList &ls, Position &pos) {
-        pos.isInCheck = false;
+    template <Side SIDE, GenType TYPE, GenOutput OUT>
+    int generate_moves(MoveList *ls, Position &pos) {
+        // captures and quiets only split the moves cleanly while captures leave out quiet checks
+        static_assert(!INCLUDE_CHECKS || TYPE != GEN_CAPTURES);
+
+        int count = 0;
+        StateInfo &st = pos.state;
 
         const Bitboard opponent = pos.by_side(opposite_side(SIDE));
         const Bitboard self = pos.by_side(SIDE);
@@ -66,57 +145,55 @@ namespace sc {
         const Square kingSq = get_lsb(kingBb);
         const Square opponentKing = get_lsb(opponent & pos.by_type(KING));
 
-        Bitboard attk = 0; // bitboard being attacked by the opposite side
-        Bitboard checkers = 0; // pieces giving check directly
-        {
-            Bitboard it = opponent & (pos.by_type(BISHOP) | pos.by_type(QUEEN));
-            checkers |= it & lookup<BISHOP_MAGICS>(kingSq, occ);
-            while (it) attk |= lookup<BISHOP_MAGICS>(pop_lsb(it), occ ^ kingBb);
-
-            it = opponent & (pos.by_type(ROOK) | pos.by_type(QUEEN));
-            checkers |= it & lookup<ROOK_MAGICS>(kingSq, occ);
-            while (it) attk |= lookup<ROOK_MAGICS>(pop_lsb(it), occ ^ kingBb);
-
-            it = opponent & pos.by_type(KNIGHT);
-            checkers |= it & knight_moves(kingSq);
-            while (it) attk |= knight_moves(pop_lsb(it));
-
-            it = opponent & pos.by_type(PAWN);
-            checkers |= it & pawn_attacks<SIDE>(kingSq);
-            while (it) attk |= pawn_attacks<opposite_side(SIDE)>(pop_lsb(it));
-
-            attk |= king_moves(get_lsb(opponent & pos.by_type(KING)));
+        // the state's checkers and attacked squares are the side to move's. the blockers and pinners are kept
+        // for both sides. the moves of the other side (for mobility, say) are worked out from scratch
+        const bool toMove = SIDE == pos.get_turn();
+        const Bitboard checkers = toMove ? st.checkers : attackers_to(pos, kingSq, occ) & opponent;
+
+        // every evasion is generated along with the captures
+        if (TYPE == GEN_QUIETS && checkers)
+            return count;
+
+        // the squares the king can't go to. the picker generates captures and quiets separately, so this is
+        // often the second time we get here for the position
+        Bitboard attk;
+        if (!toMove) {
+            attk = attacked_squares<SIDE>(pos);
+        } else {
+            if (!st.attackedValid) {
+                st.attacked = attacked_squares<SIDE>(pos);
+                st.attackedValid = true;
+            }
+            attk = st.attacked;
         }
 
         if (checkers && (checkers & (checkers - 1)) != 0) {
             // checkers more than 1 bit set: multiple pieces are giving check
             // we MUST move the king to a safe square
-            Bitboard it = king_moves(kingSq) & ~self & ~attk;
-            while (it)
-                ls.push_back(new_move_normal(kingSq, pop_lsb(it)));
-
-            pos.isInCheck = true;
-            return;
+            PUSH_MOVES(kingSq, king_moves(kingSq) & ~self & ~attk);
+            return count;
         }
 
-        // pieces that are pinned
+        // pieces that are pinned, and the line from the king up to and including the piece pinning them
+        const Bitboard pinned = st.blockers[SIDE] & self;
         Bitboard pinLines[64];
-        Bitboard pinned = calc_pinned(pos, self, opponent, opponent & ~checkers, kingSq, pinLines);
+        for (Bitboard it = st.pinners[SIDE]; it;) {
+            const Bitboard pinLine = pin_line(kingSq, pop_lsb(it));
+            pinLines[get_lsb(pinLine & self)] = pinLine;
+        }
 
-        const bool DO_QUIESC = QUIESC && !checkers;
+        const bool DO_QUIESC = TYPE == GEN_CAPTURES && !checkers;
+        constexpr bool DO_QUIETS = TYPE == GEN_QUIETS;
         Bitboard discoveryLines[64];
         Bitboard discoveredChecks = 0;
-        if (DO_QUIESC) {
+        if (DO_QUIESC && INCLUDE_CHECKS) {
             for (Bitboard &discoveryLine : discoveryLines)
                 discoveryLine = 0;
             discoveredChecks = calc_pinned(pos, self, 0ULL, self, opponentKing, discoveryLines);
         }
 
-        pos.isInCheck = false;
         Bitboard landing = ~self; // squares we are allowed to land on
         if (checkers) {
-            pos.isInCheck = true;
-
             // single check: We are being checked by a single piece. Either block or move a piece
             Square sq = get_lsb(checkers);
 
@@ -129,22 +206,23 @@ namespace sc {
         // discovered checks is only set for quiescence, which handle them specially
         Bitboard normals = self & ~pinned;
         
-        #define GET_QUIESC_TERM(checkSqs) DO_QUIESC ? occ | (INCLUDE_CHECKS ? (checkSqs) : 0ULL) : ~0ULL
+        #define GET_QUIESC_TERM(checkSqs) DO_QUIESC ? occ | (INCLUDE_CHECKS ? (checkSqs) : 0ULL) \
+                                                    : (DO_QUIETS ? ~occ : ~0ULL)
 
         if (DO_QUIESC && INCLUDE_CHECKS) normals &= ~discoveredChecks;
         {
             // note: in quiescence searches only look for moves giving check or capturing a piece
             Bitboard it = normals & (pos.by_type(BISHOP) | pos.by_type(QUEEN));
             Bitboard quiescTerm = GET_QUIESC_TERM(lookup<BISHOP_MAGICS>(opponentKing, occ));
-            ACCUM_MOVES(lookup<BISHOP_MAGICS>(SQ, occ), it, landing & quiescTerm, ls, pos);
+            ACCUM_MOVES(lookup<BISHOP_MAGICS>(SQ, occ), it, landing & quiescTerm);
 
             it = normals & (pos.by_type(ROOK) | pos.by_type(QUEEN));
             quiescTerm = GET_QUIESC_TERM(lookup<ROOK_MAGICS>(opponentKing, occ));
-            ACCUM_MOVES(lookup<ROOK_MAGICS>(SQ, occ), it, landing & quiescTerm, ls, pos);
+            ACCUM_MOVES(lookup<ROOK_MAGICS>(SQ, occ), it, landing & quiescTerm);
 
             it = normals & pos.by_type(KNIGHT);
             quiescTerm = GET_QUIESC_TERM(knight_moves(opponentKing));
-            ACCUM_MOVES(knight_moves(SQ), it, landing & quiescTerm, ls, pos);
+            ACCUM_MOVES(knight_moves(SQ), it, landing & quiescTerm);
 
             // king movement
             it = king_moves(kingSq) & ~attk & ~self;
@@ -152,12 +230,13 @@ namespace sc {
             // allow king to either capture or create discovered check
             if (DO_QUIESC)
                 it &= occ | (INCLUDE_CHECKS && (kingBb & discoveredChecks) != 0 ? ~discoveryLines[kingSq] : 0ULL);
+            if (DO_QUIETS)
+                it &= ~occ;
 
-            while (it)
-                ls.push_back(new_move_normal(kingSq, pop_lsb(it)));
+            PUSH_MOVES(kingSq, it);
 
             // castling
-            if (!checkers) {
+            if (!checkers && (!DO_QUIESC || INCLUDE_CHECKS)) {
                 constexpr auto sideIndex = (SIDE == WHITE_SIDE ? 2 : 0);
                 bool canKingside = pos.state.castlingRights & KINGSIDE_MASK << sideIndex;
                 bool canQueenside = pos.state.castlingRights & QUEENSIDE_MASK << sideIndex;
@@ -178,9 +257,9 @@ namespace sc {
                 }
 
                 if (canKingside)
-                    ls.push_back(new_move<CASTLE>(kingSq, kingSq + 2 * Dir::E));
+                    PUSH_MOVE(new_move<CASTLE>(kingSq, kingSq + 2 * Dir::E));
                 if (canQueenside)
-                    ls.push_back(new_move<CASTLE>(kingSq, kingSq + 2 * Dir::W));
+                    PUSH_MOVE(new_move<CASTLE>(kingSq, kingSq + 2 * Dir::W));
             }
 
             // pawns
@@ -196,20 +275,27 @@ namespace sc {
                 if (DO_QUIESC) {
                     Bitboard checkSqs = pawn_attacks<opposite_side(SIDE)>(opponentKing);
                     Bitboard discoveryTerm = ((to_bitboard(SQ) & discoveredChecks) != 0 ? ~discoveryLines[SQ] : 0ULL);
-                    destinations &= occ | (INCLUDE_CHECKS ? discoveryTerm | checkSqs : 0ULL);
+                    destinations &= occ | (rank_bb(8) | rank_bb(1)) | (INCLUDE_CHECKS ? discoveryTerm | checkSqs : 0ULL);
                 }
 
+                // pushes to the last rank are promotions, which go with the captures
+                if (DO_QUIETS)
+                    destinations &= ~occ & ~(rank_bb(8) | rank_bb(1));
+
                 Bitboard promotions = destinations & (rank_bb(8) | rank_bb(1));
-                while (promotions) { // always look at promotions
-                    Square dst = pop_lsb(promotions);
-                    // bishop and rook desirable for stalemate tricks
-                    for (PromoteType to: {PROMOTE_QUEEN, PROMOTE_BISHOP, PROMOTE_KNIGHT, PROMOTE_ROOK})
-                        ls.push_back(new_promotion(SQ, dst, to));
+                if constexpr (OUT == GEN_COUNT) {
+                    count += 4 * popcnt(promotions);
+                } else {
+                    while (promotions) { // always look at promotions
+                        Square dst = pop_lsb(promotions);
+                        // bishop and rook desirable for stalemate tricks
+                        for (PromoteType to: {PROMOTE_QUEEN, PROMOTE_BISHOP, PROMOTE_KNIGHT, PROMOTE_ROOK})
+                            PUSH_MOVE(new_promotion(SQ, dst, to));
+                    }
                 }
 
                 destinations &= ~(rank_bb(8) | rank_bb(1)); // these are promotion squares
-                while (destinations)
-                    ls.push_back(new_move_normal(SQ, pop_lsb(destinations)));
+                PUSH_MOVES(SQ, destinations);
             }
         }
 
@@ -245,8 +331,10 @@ namespace sc {
                     destinations &= quiescAllowed;
                 }
 
-                while (destinations)
-                    ls.push_back(new_move_normal(sq, pop_lsb(destinations)));
+                if (DO_QUIETS)
+                    destinations &= ~occ;
+
+                PUSH_MOVES(sq, destinations);
             }
         }
 
@@ -260,7 +348,7 @@ namespace sc {
         }
 
         // en passant: always allowed even in quiescence
-        if (pos.state.enPassantTarget != NULL_SQUARE) {
+        if (!DO_QUIETS && pos.state.enPassantTarget != NULL_SQUARE) {
             Bitboard it = self & pos.by_type(PAWN) & pawn_attacks<opposite_side(SIDE)>(pos.state.enPassantTarget);
             Bitboard ep = to_bitboard(pos.state.enPassantTarget);
 
@@ -284,15 +372,71 @@ namespace sc {
                         (pos.by_type(QUEEN) | pos.by_type(ROOK)));
 
                 if ((PIN_PASSED) && (CHECK_PASSED) && (TARGET_PASSED))
-                    ls.push_back(new_move<EN_PASSANT>(sq, pos.get_state().enPassantTarget));
+                    PUSH_MOVE(new_move<EN_PASSANT>(sq, pos.get_state().enPassantTarget));
             }
         }
+
+        return count;
     }
 
-    template void standard_moves<BLACK_SIDE, false>(MoveList &, Position &);
-    template void standard_moves<WHITE_SIDE, false>(MoveList &, Position &);
+    template int generate_moves<BLACK_SIDE, GEN_ALL, GEN_LIST>(MoveList *, Position &);
+    template int generate_moves<WHITE_SIDE, GEN_ALL, GEN_LIST>(MoveList *, Position &);
 
-    template void standard_moves<BLACK_SIDE, true>(MoveList &, Position &);
-    template void standard_moves<WHITE_SIDE, true>(MoveList &, Position &);
+    template int generate_moves<BLACK_SIDE, GEN_CAPTURES, GEN_LIST>(MoveList *, Position &);
+    template int generate_moves<WHITE_SIDE, GEN_CAPTURES, GEN_LIST>(MoveList *, Position &);
 
-}
\ No newline at end of file
+    template int generate_moves<BLACK_SIDE, GEN_QUIETS, GEN_LIST>(MoveList *, Position &);
+    template int generate_moves<WHITE_SIDE, GEN_QUIETS, GEN_LIST>(MoveList *, Position &);
+
+    template int generate_moves<BLACK_SIDE, GEN_ALL, GEN_COUNT>(MoveList *, Position &);
+    template int generate_moves<WHITE_SIDE, GEN_ALL, GEN_COUNT>(MoveList *, Position &);
+
+    template int generate_moves<BLACK_SIDE, GEN_ALL, GEN_ANY>(MoveList *, Position &);
+    template int generate_moves<WHITE_SIDE, GEN_ALL, GEN_ANY>(MoveList *, Position &);
+
+    bool is_legal(Position &pos, const Move mov) {
+        const Side us = pos.get_turn();
+        const ColoredType piece = pos.piece_at(mov.src);
+        if (mov.src == mov.dst || piece == NULL_COLORED_TYPE || side_of(piece) != us)
+            return false;
+
+        // rare enough that generating everything is fine
+        if (mov.typeFlags != NORMAL) {
+            MoveList ls(0);
+            generate_legal<GEN_ALL>(ls, pos);
+            return std::find(ls.begin(), ls.end(), mov) != ls.end();
+        }
+
+        const Bitboard self = pos.by_side(us);
+        const Bitboard opponent = pos.by_side(opposite_side(us));
+        const Bitboard occ = self | opponent;
+        const Bitboard dst = to_bitboard(mov.dst);
+        if (dst & (self | pos.by_type(KING)))
+            return false;
+
+        Bitboard reach;
+        switch (type_of(piece)) {
+            case PAWN:
+                if (dst & (rank_bb(8) | rank_bb(1))) // that would have to be a promotion
+                    return false;
+                reach = us == WHITE_SIDE
+                        ? (pawn_attacks<WHITE_SIDE>(mov.src) & opponent) | pawn_moves<WHITE_SIDE>(mov.src, occ)
+                        : (pawn_attacks<BLACK_SIDE>(mov.src) & opponent) | pawn_moves<BLACK_SIDE>(mov.src, occ);
+                break;
+            case KNIGHT: reach = knight_moves(mov.src); break;
+            case BISHOP: reach = lookup<BISHOP_MAGICS>(mov.src, occ); break;
+            case ROOK: reach = lookup<ROOK_MAGICS>(mov.src, occ); break;
+            case QUEEN: reach = lookup<BISHOP_MAGICS>(mov.src, occ) | lookup<ROOK_MAGICS>(mov.src, occ); break;
+            case KING: reach = king_moves(mov.src); break;
+            default: return false;
+        }
+
+        if (!(reach & dst))
+            return false;
+
+        // the move is pseudo-legal. it is legal if it doesn't leave our king attacked by anything it didn't capture
+        const Square kingSq = type_of(piece) == KING ? mov.dst : get_lsb(self & pos.by_type(KING));
+        return !(attackers_to(pos, kingSq, (occ ^ to_bitboard(mov.src)) | dst) & opponent & ~dst);
+    }
+
+}
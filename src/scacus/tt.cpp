@@ -0,0 +1,97 @@
+#include "scacus/tt.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace sc {
+    TranspositionTable tt{};
+
+    constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    TranspositionTable::~TranspositionTable() {
+        free_table();
+    }
+
+    void TranspositionTable::free_table() {
+        if (!table) return;
+
+#if defined(MAP_HUGETLB)
+        if (hugeTlb)
+            munmap(table, allocSize);
+        else
+#endif
+            std::free(table);
+
+        table = nullptr;
+        numBuckets = 0;
+        allocSize = 0;
+    }
+
+    void TranspositionTable::resize(size_t mb) {
+        free_table();
+
+        allocSize = std::max<size_t>(HUGE_PAGE_SIZE, (mb << 20) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+        void *mem = nullptr;
+        hugeTlb = false;
+
+#if defined(MAP_HUGETLB)
+        // explicit huge pages only exist if the admin reserved some (vm.nr_hugepages), so this usually fails
+        mem = mmap(nullptr, allocSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mem == MAP_FAILED)
+            mem = nullptr;
+        hugeTlb = mem != nullptr;
+#endif
+
+        if (!mem) {
+            mem = std::aligned_alloc(HUGE_PAGE_SIZE, allocSize);
+#if defined(MADV_HUGEPAGE)
+            // ask for transparent huge pages. cuts down on TLB misses from random accesses into the table
+            if (mem) madvise(mem, allocSize, MADV_HUGEPAGE);
+#endif
+        }
+
+        if (!mem) {
+            std::cout << "info string failed to allocate " << mb << "MB for the transposition table" << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+
+        table = static_cast<Bucket *>(mem);
+        numBuckets = allocSize / sizeof(Bucket);
+        dirty = true;
+    }
+
+    void TranspositionTable::clear(unsigned threads) {
+        threads = std::max(1U, threads);
+        const size_t stride = (numBuckets + threads - 1) / threads;
+
+        // zeroing the table is also what first touches its pages, so every thread faulting in its own chunk
+        // spreads that cost across cores (and across NUMA nodes, when there are several)
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < threads; i++) {
+            const size_t begin = std::min(numBuckets, i * stride);
+            const size_t end = std::min(numBuckets, begin + stride);
+            workers.emplace_back([this, begin, end]() {
+                std::memset(static_cast<void *>(table + begin), 0, (end - begin) * sizeof(Bucket));
+            });
+        }
+
+        for (auto &w : workers)
+            w.join();
+
+        dirty = false;
+        age = 0;
+    }
+
+    void TranspositionTable::prepare(unsigned threads) {
+        if (!allocated())
+            resize(DEFAULT_HASH_MB);
+        if (dirty)
+            clear(threads);
+    }
+}
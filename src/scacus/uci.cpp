@@ -1,74 +1,50 @@
 #include "scacus/uci.hpp"
+#include "scacus/config.hpp"
+#include "scacus/key_history.hpp"
+#include "scacus/nnue.hpp"
 
 #include <chrono>
 #include <mutex>
 #include <sstream>
+#include <syncstream>
 
 #include <fstream>
 
 namespace sc {
 
-#define COUT std::cout
+// every statement is written out in one piece, so lines printed by the search threads don't get mixed up
+#define COUT std::osyncstream(std::cout)
 
-    template <bool ROOT>
-    uint64_t perft2(Position &pos, int depth) {
-        sc::MoveList legals = legal_moves_from<false>(pos);
-        uint64_t ret = 0, res = 0;
-        const bool leaf_coneybear = (depth == 2);
+    // positions searched by the bench command
+    constexpr const char *BENCH_FENS[] = {
+        STARTING_POS_FEN,
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP2BPPP/R2QKB1R w KQ - 0 8",
+        "2r2rk1/1bqnbppp/p2ppn2/1p6/3NP3/1BN1BP2/PPPQ2PP/2KR3R w - - 0 14",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+    };
 
-        for (const auto &m : legals) {
-            StateInfo undo;
-            if (!ROOT || depth > 1) {
-                sc::make_move(pos, m, &undo);
-                if (leaf_coneybear)
-                    ret += (res = legal_moves_from<false>(pos).size());
-                else
-                    ret += (res = perft2<false>(pos, depth - 1));
-                sc::unmake_move(pos, m);
-            } else {
-                res = 1;
-                ret++;
-            }
-
-            if constexpr (ROOT)
-                std::cout << m.long_alg_notation() << ": " << res << '\n';
-        }
-
-        return ret;
+    // a null move means there was nothing legal to play
+    static void print_bestmove(const Move best, const Move ponder) {
+        COUT << "bestmove " << (best == Move{} ? "0000" : best.long_alg_notation())
+             << (ponder == Move{} ? "" : " ponder " + ponder.long_alg_notation()) << std::endl;
     }
-    template uint64_t perft2<true>(Position &, int);
-    template uint64_t perft2<false>(Position &, int);
 
-    void workerFunc(UCI *uci) {
+    bool UCI::init_tables() {
         auto start = std::chrono::high_resolution_clock::now();
         sc::init_movegen();
         auto duration = std::chrono::high_resolution_clock::now() - start;
-        COUT << "info string Magic generation took ";
-        COUT << std::chrono::duration_cast<std::chrono::milliseconds>(duration).count() << "ms\n";
-
-        uci->stateHead = uci->states;
-        uci->pos.set_state_from_fen(STARTING_POS_FEN);
-        uci->eng.set_pos(&uci->pos);
-        // uci->eng.start_search();
-        // std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        // uci->eng.stop_search();
-
-        // first search is buggy for some reason. hacky fix
-
-        uci->readyok = true;
-//        uci->workerToMain.notify_all();
-
-        while (uci->running) {
-            {
-//                std::unique_lock<std::mutex> lg(uci->mtx);
-//                uci->mainToWorker.wait(lg, [&]() -> bool { return uci->go || !uci->running; });
-                if (!uci->running) return;
-            }
+        COUT << "info string Magic generation took "
+             << std::chrono::duration_cast<std::chrono::milliseconds>(duration).count() << "ms\n";
+        return true;
+    }
 
-//            Position cpy = uci->pos;
-            // COUT << "bestmove " << uci->eng.primitive_search(cpy, 3).first.long_alg_notation() << '\n';
-            uci->go = false;
-        }
+    UCI::UCI() {
+        stateHead = states;
+        pos.set_state_from_fen(STARTING_POS_FEN);
+        eng.set_pos(&pos);
+        eng.set_bestmove_callback(print_bestmove);
     }
 
     void UCI::run() {
@@ -76,8 +52,9 @@ namespace sc {
         running = true;
         while (running) {
             std::string line;
-            std::getline(std::cin, line);
-            running = !std::cin.eof();
+            // losing stdin is as good as being told to quit
+            if (!std::getline(std::cin, line))
+                line = "quit";
 
             process_cmd(line);
         }
@@ -130,21 +107,229 @@ namespace sc {
                 else
                     sc::make_move(pos, mov, stateHead++);
 
-                if (pos.get_state().reps > 0) {
+                constexpr int MAX_STATES = sizeof(states) / sizeof(states[0]);
+                KeyHistory<MAX_STATES + 1> keys;
+                keys.seed(pos, MAX_STATES);
+                if (keys.is_repetition(pos.get_state().halfmoves)) {
                     std::cout << "REPETITION DETECTED\n";
                 }
             }
         }
     }
 
-    void run_perft(Position &pos, int depth) {
+    SearchLimits UCI::parse_limits(const std::string &in) {
+        std::istringstream stream(in);
+        std::string tok;
+        SearchLimits lim;
+
+        while (stream >> tok) {
+            if (tok == "wtime") stream >> lim.time[WHITE_SIDE];
+            else if (tok == "btime") stream >> lim.time[BLACK_SIDE];
+            else if (tok == "winc") stream >> lim.inc[WHITE_SIDE];
+            else if (tok == "binc") stream >> lim.inc[BLACK_SIDE];
+            else if (tok == "movestogo") stream >> lim.movestogo;
+            else if (tok == "movetime") stream >> lim.movetime;
+            else if (tok == "depth") stream >> lim.depth;
+            else if (tok == "nodes") stream >> lim.nodes;
+            else if (tok == "infinite") lim.infinite = true;
+            else if (tok == "ponder") lim.ponder = true;
+        }
+
+        // the GUI can send a negative time if we're already running on fumes
+        for (auto &t : lim.time) t = std::max<int64_t>(1, t) * (t != 0);
+        lim.depth = std::clamp(lim.depth, 1, MAX_DEPTH);
+        return lim;
+    }
+
+    void UCI::setoption(const std::string &in) {
+        std::istringstream stream(in);
+        std::string tok, name, value;
+
+        stream >> tok; // "name"
+        while (stream >> tok && tok != "value")
+            name += (name.empty() ? "" : " ") + tok;
+        std::getline(stream >> std::ws, value);
+
+        if (name == "UCI_Variant") {
+            variant = value == "antichess" ? Variant::ANTICHESS : Variant::STANDARD;
+        } else if (name == "Move Overhead") {
+            eng.set_move_overhead(std::stoi(value));
+        } else if (name == "Threads") {
+            eng.set_threads(std::stoi(value));
+        } else if (name == "Hash") {
+            // zeroed by the next isready/ucinewgame, so the GUI doesn't time out on us here
+            tt.resize(std::stoull(value));
+        } else if (name == "NullMovePruning") {
+            eng.search_options().nullMove = value == "true";
+        } else if (name == "LateMoveReductions") {
+            eng.search_options().lmr = value == "true";
+        } else if (name == "FutilityPruning") {
+            eng.search_options().futility = value == "true";
+        } else if (name == "DeltaPruning") {
+            eng.search_options().deltaPruning = value == "true";
+        } else if (name == "UseNNUE") {
+            eng.search_options().nnue = value == "true";
+            eng.clear_eval_caches();
+            if (eng.search_options().nnue && !nnue::has_network())
+                COUT << "info string no network loaded, set EvalFile first" << std::endl;
+        } else if (name == "EvalFile") {
+            if (value.empty() || value == "<empty>")
+                return;
+            if (nnue::load_network(value)) {
+                eng.clear_eval_caches();
+                COUT << "info string loaded network " << value << std::endl;
+            } else {
+                COUT << "info string failed to load network " << value << ": missing, or not a ("
+                     << nnue::INPUTS << "->" << nnue::HIDDEN << ")x2->1 network" << std::endl;
+            }
+        }
+    }
+
+    // searches each of BENCH_FENS for `ms` milliseconds with 1, 2, 4, ... threads up to the
+    // configured thread count, and reports the nodes per second reached at each thread count, along with
+    // the average share of beta cutoffs caused by the first move searched.
+    void UCI::bench(int ms) {
+        const unsigned maxThreads = eng.get_threads();
+        Position benchPos;
+        eng.set_pos(&benchPos);
+        eng.set_bestmove_callback(nullptr);
+
+        for (unsigned threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+            eng.set_threads(threads);
+            uint64_t nodes = 0, probeCycles = 0;
+            double firstCut = 0;
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (const char *fen : BENCH_FENS) {
+                benchPos.set_state_from_fen(fen);
+                eng.start_search();
+                std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+                eng.stop_search();
+                nodes += eng.node_count();
+                probeCycles += eng.tt_probe_cycles();
+                firstCut += eng.first_move_cutoff_rate() / std::size(BENCH_FENS);
+            }
+            auto diff = std::chrono::high_resolution_clock::now() - start;
+            auto secs = (double) std::chrono::duration_cast<std::chrono::microseconds>(diff).count() / 1000000.0;
+
+            COUT << "info string bench threads " << threads << " nodes " << nodes
+                 << " nps " << (uint64_t) (nodes / secs) << " firstcut " << firstCut * 100 << "%";
+            if (TIME_TT_PROBES)
+                COUT << " ttcycles/node " << (double) probeCycles / std::max<uint64_t>(1, nodes);
+            COUT << std::endl;
+
+            if (threads == maxThreads) break;
+        }
+
+        eng.set_threads(maxThreads);
+        eng.set_pos(&pos);
+        eng.set_bestmove_callback(print_bestmove);
+    }
+
+    // searches each of BENCH_FENS to a fixed depth from an empty transposition table, and reports the
+    // nodes each took. with Threads at 1 the counts are deterministic, so the search options can be A/B'd
+    void UCI::bench_depth(DepthT depth) {
+        Position benchPos;
+        eng.set_pos(&benchPos);
+        eng.set_bestmove_callback(nullptr);
+
+        uint64_t total = 0;
         auto start = std::chrono::high_resolution_clock::now();
-        uint64_t res = perft2<true>(pos, depth);
-        auto diff = std::chrono::high_resolution_clock::now() - start;
-        auto nps = (double) res / ((double) std::chrono::duration_cast<std::chrono::microseconds>(diff).count() / 1000000.0);
+        for (const char *fen : BENCH_FENS) {
+            benchPos.set_state_from_fen(fen);
+            tt.clear(eng.get_threads());
+            eng.start_search(depth);
+            eng.wait_search();
+
+            total += eng.node_count();
+            COUT << "info string bench depth " << depth << " nodes " << eng.node_count()
+                 << " firstcut " << eng.first_move_cutoff_rate() * 100 << "% pawnhits "
+                 << eng.pawn_hash_hit_rate() * 100 << "% evalhits " << eng.eval_cache_hit_rate() * 100
+                 << "% fen " << fen << std::endl;
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+        COUT << "info string bench depth " << depth << " total nodes " << total << " time " << ms
+             << " nps " << total * 1000 / (ms + 1) << std::endl;
 
-        std::cout << "Nodes searched (depth=" << depth << "): " << res;
-        std::cout << " (" << nps / 1000000.0 << " mnps)" << std::endl;
+        eng.set_pos(&pos);
+        eng.set_bestmove_callback(print_bestmove);
+    }
+
+    // searches each of BENCH_FENS to a fixed depth from an empty transposition table with 1, 2, 4, ... threads
+    // up to the configured thread count, and reports the wall clock time each thread count took, and how
+    // much faster than a single thread that is. more nodes per second only help if they get deeper sooner
+    void UCI::bench_time_to_depth(DepthT depth) {
+        const unsigned maxThreads = eng.get_threads();
+        Position benchPos;
+        eng.set_pos(&benchPos);
+        eng.set_bestmove_callback(nullptr);
+
+        int64_t singleUs = 0;
+        for (unsigned threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+            eng.set_threads(threads);
+            uint64_t nodes = 0;
+
+            int64_t us = 0;
+            for (const char *fen : BENCH_FENS) {
+                benchPos.set_state_from_fen(fen);
+                tt.clear(threads);
+
+                auto start = std::chrono::high_resolution_clock::now();
+                eng.start_search(depth);
+                eng.wait_search();
+                us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+                nodes += eng.node_count();
+            }
+            if (threads == 1)
+                singleUs = us;
+
+            COUT << "info string bench ttd depth " << depth << " threads " << threads << " time " << us / 1000
+                 << " nodes " << nodes << " speedup " << (double) singleUs / (double) std::max<int64_t>(1, us)
+                 << std::endl;
+
+            if (threads == maxThreads) break;
+        }
+
+        eng.set_threads(maxThreads);
+        eng.set_pos(&pos);
+        eng.set_bestmove_callback(print_bestmove);
+    }
+
+    // measures what a TT probe costs when it has to go to memory, and how much of that a prefetch hides.
+    // each iteration generates moves for a position (standing in for the work a node does between
+    // make_move and the probe) and probes a random key, optionally prefetching that key first.
+    void UCI::bench_tt() {
+        constexpr int ITERATIONS = 1 << 22;
+        tt.prepare(eng.get_threads());
+
+        std::vector<uint64_t> keys(ITERATIONS);
+        uint64_t seed = 0x3b1f6a0d7cc5e921ULL;
+        for (auto &k : keys) k = rand_u64(seed);
+
+        Position benchPos{BENCH_FENS[1]};
+        auto run = [&](bool doWork, bool doProbe, bool doPrefetch) {
+            uint64_t sink = 0;
+            TTData entry;
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < ITERATIONS; i++) {
+                if (doPrefetch) tt.prefetch(keys[i]);
+                if (doWork) sink += legal_moves_from<false>(benchPos).size();
+                if (doProbe) sink += tt.probe(keys[i], entry);
+            }
+            auto diff = std::chrono::high_resolution_clock::now() - start;
+
+            // keep the compiler from throwing away the loop
+            if (sink == 0xdeadbeef) COUT << "";
+            return (double) std::chrono::duration_cast<std::chrono::nanoseconds>(diff).count() / ITERATIONS;
+        };
+
+        COUT << "info string bench tt " << tt.size_mb() << "MB"
+             << " probe " << run(false, true, false) << "ns"
+             << " movegen " << run(true, false, false) << "ns"
+             << " movegen+probe " << run(true, true, false) << "ns"
+             << " prefetch+movegen+probe " << run(true, true, true) << "ns" << std::endl;
     }
 
     void UCI::process_cmd(const std::string &line) {
@@ -153,36 +338,87 @@ namespace sc {
         if (line == "uci") {
             // just pretend :) these are required for the lichess-bot python thing
             // to play nice with our engine.
-            COUT << "option name Hash type spin default 16 min 1 max 33554432\n"
-                    "option name Threads type spin default 1 min 1 max 512\n"
+            COUT << "option name Hash type spin default " << DEFAULT_HASH_MB << " min 1 max 33554432\n"
+                    "option name Threads type spin default " << eng.get_threads() << " min 1 max 512\n"
                     "option name Move Overhead type spin default 10 min 0 max 5000\n"
+                    "option name Ponder type check default false\n"
+                    "option name NullMovePruning type check default true\n"
+                    "option name LateMoveReductions type check default true\n"
+                    "option name FutilityPruning type check default true\n"
+                    "option name DeltaPruning type check default true\n"
+                    "option name UseNNUE type check default false\n"
+                    "option name EvalFile type string default <empty>\n"
                     "option name UCI_Variant type combo default chess var 3check var 5check var ai-wok var almost var amazon var antichess var armageddon var asean var ataxx var atomic var breakthrough var bughouse var cambodian var chaturanga var chess var chessgi var chigorin var clobber var codrus var coregal var crazyhouse var dobutsu var euroshogi var extinction var fairy var fischerandom var gardner var giveaway var gorogoro var grasshopper var hoppelpoppel var horde var judkins var karouk var kinglet var kingofthehill var knightmate var koedem var kyotoshogi var loop var losalamos var losers var makpong var makruk var micro var mini var minishogi var minixiangqi var newzealand var nightrider var nocastle var nocheckatomic var normal var placement var pocketknight var racingkings var seirawan var shatar var shatranj var shouse var sittuyin var suicide var threekings var torishogi\n"
                     "uciok\n";
         } else if (line.rfind("setoption", 0) == 0) {
-            if (line.find("antichess") != std::string::npos) {
-                variant = Variant::ANTICHESS;
-            } else {
-                variant = Variant::STANDARD;
-            }
+            eng.stop_search();
+            setoption(line.substr(9));
         } else if (line.rfind("isready", 0) == 0) {
-//            std::unique_lock<std::mutex> lg(mtx);
-//            workerToMain.wait(lg, [&]() -> bool { return readyok; });
-            COUT << "readyok\n";
+            // a search that is still running is using the table, so leave it alone
+            if (!eng.is_running()) {
+                eng.wait_search();
+                tt.prepare(eng.get_threads());
+            }
+            COUT << "readyok" << std::endl;
         } else if (line == "ucinewgame") {
-            ; // nothing
+            eng.stop_search();
+            // old entries are useless for a new game, so wipe them now rather than letting them age out
+            if (tt.allocated())
+                tt.clear(eng.get_threads());
+            else
+                tt.prepare(eng.get_threads());
         } else if (line.rfind("position", 0) == 0) {
+            eng.stop_search();
             position(line.substr(8));
         } else if (line.rfind("go perft", 0) == 0) {
-            int num = std::stoi(line.substr(8));
+            eng.stop_search();
+            std::istringstream stream(line.substr(8));
+            int num = 0;
+            stream >> num;
 
-            run_perft(pos, num);
+            // go perft <depth> [threads <n>] [hash <mb>]
+            std::string tok;
+            unsigned threads = 0;
+            size_t hashMb = 0;
+            while (stream >> tok) {
+                if (tok == "threads") stream >> threads;
+                else if (tok == "hash") stream >> hashMb;
+            }
+
+            if (threads || hashMb)
+                run_perft(pos, num, std::max(threads, 1U), hashMb);
+            else
+                run_perft(pos, num);
         } else if (line.rfind("go", 0) == 0) {
-            // go = true;
-            eng.start_search(6);
-            std::this_thread::sleep_for(std::chrono::seconds(8));
+            // the search prints bestmove by itself when it is done
+            eng.stop_search();
+            eng.start_search(parse_limits(line.substr(2)));
+        } else if (line == "ponderhit") {
+            eng.ponderhit();
+        } else if (line == "stop") {
+            // the bestmove is printed from inside stop_search(), before it returns
+            auto start = std::chrono::high_resolution_clock::now();
+            const bool wasRunning = eng.is_running();
+            eng.stop_search();
+            auto diff = std::chrono::high_resolution_clock::now() - start;
+
+            if (wasRunning)
+                COUT << "info string stop took "
+                     << std::chrono::duration_cast<std::chrono::microseconds>(diff).count() << "us" << std::endl;
+        } else if (line == "bench tt") {
             eng.stop_search();
-            COUT << "bestmove " << eng.best_move().long_alg_notation() << std::endl;
+            bench_tt();
+        } else if (line.rfind("bench ttd", 0) == 0) {
+            eng.stop_search();
+            bench_time_to_depth(std::stoi(line.substr(9)));
+        } else if (line.rfind("bench depth", 0) == 0) {
+            eng.stop_search();
+            bench_depth(std::stoi(line.substr(11)));
+        } else if (line.rfind("bench", 0) == 0) {
+            eng.stop_search();
+            bench(line.size() > 5 ? std::stoi(line.substr(5)) : 1000);
         } else if (line == "quit") {
+            eng.stop_search();
             running = false;
         } else if (line == "d") {
             dbg_dump_position(pos);